@@ -6,16 +6,62 @@
 
 // ------------------------- LED Configuration -------------------------
 #define LED_PIN             2
-#define NUM_LEDS            300
+#ifndef MAX_NUM_LEDS
+#define MAX_NUM_LEDS        1500    // largest supported strip; sizes the static frame arena
+#endif
+#define DEFAULT_NUM_LEDS    300     // LED count until one is configured (applied at boot)
+// The logical strip can be split into consecutive segments on separate data
+// lines, each its own FastLED controller on its own RMT channel, so the
+// refresh time follows the longest segment instead of the whole strip (the
+// C3 has two RMT TX channels). Segments share the LED count evenly.
+#ifndef LED_SEGMENTS
+#define LED_SEGMENTS        1       // 1..4
+#endif
+#define LED_PIN_2           3
+#define LED_PIN_3           4
+#define LED_PIN_4           5
+#ifndef LED_REVERSED_SEGMENTS
+#define LED_REVERSED_SEGMENTS 0x0   // bit n set = segment n is wired from its far end
+#endif
 #define CHIPSET             WS2812B
 #define COLOR_ORDER         GRB
+#define LED_KEEPALIVE_INTERVAL 1000   // ms; resend an unchanged frame this often (0 = never)
+#define LED_MIN_FRAME_INTERVAL 10     // ms; shortest frame period, whatever the update interval is set to
+
+// Frame scheduling. While the beam is on, frames are rendered on a fixed
+// cadence of the update interval. With the light on but the beam off the
+// strip is re-evaluated every LED_IDLE_INTERVAL, or as soon as the sensor
+// reports motion or a setting changes. With the light off the LED task only
+// wakes for a setting change or the keep-alive.
+#define LED_IDLE_INTERVAL   250       // ms
+#define COMPOSITOR_MAX_LAYERS  8      // effect layers the frame compositor can stack
+#define COMPOSITOR_CHUNK       32     // pixels blended per pass through the compositor's scratch buffer
 
 // ------------------------- Sensor Parameters -------------------------
 #define SENSOR_HEADER       0xAA
+#define SENSOR_FRAME_LENGTH 7       // two header bytes + 5 payload bytes
+#ifndef SENSOR_CHECKSUM
+#define SENSOR_CHECKSUM     0       // 1 = last payload byte is the 8-bit sum of the others
+#endif
 #define MIN_DISTANCE        20
 #define MAX_DISTANCE        1000
 #define DEFAULT_DISTANCE    1000
 #define NOISE_THRESHOLD     5
+#define SENSOR_HISTORY_SIZE 512     // recent samples kept for the live stream and history export (power of two)
+
+// ------------------------- Tracking Filter -------------------------
+#define TRACK_MEDIAN_WINDOW       5       // raw samples in the median outlier filter
+#define TRACK_ALPHA               0.4f    // alpha-beta filter position gain
+#define TRACK_BETA                0.05f   // alpha-beta filter velocity gain
+#define TRACK_GATE                50      // residual (distance units) still counted as consistent
+#define TRACK_RESET_TIMEOUT       1000    // ms without samples before the track reports no motion and restarts
+#define TRACK_MIN_CONFIDENCE      30      // confidence needed before motion is reported
+#define MOTION_VELOCITY_THRESHOLD 25.0f   // distance units per second that count as movement
+
+// ------------------------- Beam Prediction -------------------------
+#define PREDICTION_LATENCY_OFFSET 5       // ms; sensor and output latency not covered by the sample age
+#define PREDICTION_MAX_LEAD       250     // ms; upper bound on how far ahead the beam is placed
+#define MAX_SPEED_MULTIPLIER      4.0
 
 // ------------------------- Default Display Parameters -------------------------
 #define DEFAULT_UPDATE_INTERVAL     20
@@ -25,7 +71,7 @@
 #define DEFAULT_CENTER_SHIFT        0
 #define DEFAULT_ADDITIONAL_LEDS     0
 #define DEFAULT_BASE_COLOR          CRGB(255, 200, 50)
-#define DEFAULT_SPEED_MULTIPLIER    2.0
+#define DEFAULT_SPEED_MULTIPLIER    1.0     // prediction lead as a multiple of the measured latency (0 = off)
 #define DEFAULT_LED_OFF_DELAY       5
 
 // ------------------------- Default Time and Schedule Parameters -------------------------
@@ -34,8 +80,27 @@
 #define DEFAULT_END_HOUR      8
 #define DEFAULT_END_MINUTE    30
 
-// ------------------------- EEPROM -------------------------
-#define EEPROM_SIZE 64
+// ------------------------- Settings Storage -------------------------
+#define EEPROM_SIZE 64    // legacy settings layout, only read to migrate old installs
+#define SETTINGS_FLUSH_QUIET      2000    // ms without changes before pending settings are written
+#define SETTINGS_FLUSH_MAX_DELAY  10000   // ms a change may stay unwritten during a long burst
+#define SETTINGS_FLUSH_POLL       250     // ms between checks of the storage task
+
+// ------------------------- Logging -------------------------
+#ifndef LOG_LEVEL
+#define LOG_LEVEL           3       // 1 error, 2 warn, 3 info, 4 debug; higher levels cost one compare
+#endif
+#define LOG_RING_SIZE       32      // queued records (power of two); when full, new ones are dropped
+#define LOG_MAX_ARGS        4       // numeric arguments per record
+#define LOG_TEXT_LENGTH     48      // bytes of string arguments copied per record
+#define LOG_DRAIN_INTERVAL  20      // ms between checks of the log task
+
+// ------------------------- Web Server -------------------------
+#define STREAM_MAX_CLIENTS    4       // concurrent live sensor streams (each holds a socket)
+#define STREAM_BATCH_INTERVAL 100     // ms; new samples are pushed in one batch this often
+#define STREAM_BATCH_MAX      64      // samples per batch; a stream further behind skips ahead
+#define STREAM_KEEPALIVE      15000   // ms; keep-alive event sent to streams with nothing new
+#define CONFIG_MAX_BODY       512     // bytes; larger /api/config requests are refused
 
 // ------------------------- WiFi Settings -------------------------
 #define AP_PASSWORD "12345678"
@@ -45,7 +110,9 @@
 #define MQTT_RECONNECT_DELAY 5000  // 5 seconds
 #define MQTT_DISCOVERY_PREFIX "homeassistant"
 #define MQTT_NODE_ID "lighttrack"
-#define HA_DISCOVERY_DELAY 10000   // 10 seconds delay between discovery messages
+#define HA_STATUS_TOPIC "homeassistant/status"   // HomeAssistant announces restarts here
+#define MQTT_PUBLISH_WINDOW 500    // ms; state changes are published at most this often
+#define MQTT_BUFFER_SIZE 1024      // bytes; PubSubClient packet buffer, must hold the largest payload
 
 // Serial settings for sensor
 #define SENSOR_BAUD_RATE 256000
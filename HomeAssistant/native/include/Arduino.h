@@ -0,0 +1,160 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host-side stand-in for the parts of the Arduino-ESP32 core used by
+// led_controller.cpp, sensor_manager.cpp and storage.cpp. Only built by
+// [env:native]; the firmware itself always uses the real core.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::min;
+using std::max;
+using std::abs;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define HEX 16
+#define DEC 10
+#define SERIAL_8N1 0x800001c
+
+// ------------------------- Simulated clock -------------------------
+// millis()/micros() run on a simulated clock that only moves when
+// vTaskDelay() or nativeAdvanceMillis() is called, so scripted runs are
+// deterministic.
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void nativeAdvanceMillis(unsigned long ms);
+
+// ------------------------- FreeRTOS -------------------------
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef void * TaskHandle_t;
+
+#define portTICK_PERIOD_MS  1
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+
+typedef enum {
+  eNoAction = 0,
+  eSetBits,
+  eIncrement,
+  eSetValueWithOverwrite,
+  eSetValueWithoutOverwrite
+} eNotifyAction;
+
+// There is no scheduler on the host: the current task handle is a dummy,
+// notifications are dropped and waiting for one times out immediately
+// after advancing the simulated clock by the timeout.
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t timeIncrement);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+BaseType_t xTaskNotifyWait(uint32_t bitsToClearOnEntry, uint32_t bitsToClearOnExit,
+                           uint32_t *notificationValue, TickType_t ticksToWait);
+
+// ------------------------- String -------------------------
+class String : public std::string {
+public:
+  String() {}
+  String(const char *s) : std::string(s ? s : "") {}
+  String(const std::string &s) : std::string(s) {}
+  explicit String(int value, unsigned char base = DEC);
+  explicit String(unsigned int value, unsigned char base = DEC);
+  explicit String(long value, unsigned char base = DEC);
+  explicit String(unsigned long value, unsigned char base = DEC);
+  explicit String(float value, unsigned int decimalPlaces = 2);
+  explicit String(double value, unsigned int decimalPlaces = 2);
+
+  bool isEmpty() const { return empty(); }
+  long toInt() const { return strtol(c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(c_str(), nullptr); }
+};
+
+// ------------------------- Serial -------------------------
+// Output is formatted into a stack buffer and written to stdout only when
+// nativeSerialEcho(true) is set, so printing in the render path costs the
+// formatting work but never allocates.
+class HardwareSerial {
+public:
+  explicit HardwareSerial(int port) : _port(port) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+  void end() {}
+
+  int available();
+  int read();
+  int peek();
+  size_t readBytes(uint8_t *buffer, size_t length);
+  size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+
+  // RX callback, invoked by nativeFeed() like the UART event task would
+  typedef void (*OnReceiveCb)();
+  void onReceive(OnReceiveCb function, bool onlyOnTimeout = false) { _onReceive = function; }
+
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+  size_t print(const char *s);
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t print(char c);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+
+  template <typename T>
+  size_t println(const T &value) { size_t n = print(value); return n + print("\r\n"); }
+  size_t println() { return print("\r\n"); }
+
+  // Queue bytes as if they had arrived on the RX pin.
+  size_t nativeFeed(const uint8_t *data, size_t length);
+  void nativeFlushRx();
+
+  static const size_t RX_BUFFER_SIZE = 256;
+
+private:
+  size_t emit(const char *s, size_t length);
+
+  int _port;
+  OnReceiveCb _onReceive = nullptr;
+  uint8_t _rx[RX_BUFFER_SIZE];
+  size_t _rxHead = 0;
+  size_t _rxCount = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+void nativeSerialEcho(bool enabled);
+
+// Also hand everything printed to Serial to sink (NULL to stop), for tests
+// that check the output
+typedef void (*NativeSerialSink)(const char *data, size_t length);
+void nativeSerialCapture(NativeSerialSink sink);
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,47 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+// Host-side stand-in for the ESP32 EEPROM emulation: a RAM image that
+// starts zeroed like a fresh NVS blob and counts commits instead of
+// writing flash.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class EEPROMClass {
+public:
+  bool begin(size_t size);
+  void end() {}
+
+  uint8_t read(int address) { return _data[address]; }
+  void write(int address, uint8_t value) { _data[address] = value; }
+  bool commit() { _commits++; return true; }
+
+  template <typename T>
+  T &get(int address, T &t) {
+    memcpy((void *)&t, _data + address, sizeof(T));
+    return t;
+  }
+
+  template <typename T>
+  const T &put(int address, const T &t) {
+    memcpy(_data + address, (const void *)&t, sizeof(T));
+    return t;
+  }
+
+  size_t length() const { return _size; }
+  unsigned long nativeCommitCount() const { return _commits; }
+
+  static const size_t MAX_SIZE = 4096;
+
+private:
+  uint8_t _data[MAX_SIZE];
+  size_t _size = 0;
+  bool _initialized = false;
+  unsigned long _commits = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // NATIVE_EEPROM_H
@@ -0,0 +1,139 @@
+#ifndef NATIVE_FASTLED_H
+#define NATIVE_FASTLED_H
+
+// Host-side stand-in for the subset of FastLED used by the firmware.
+// Pixel math (scale8, nscale8, fill_solid) follows FastLED's C fallbacks
+// with FASTLED_SCALE8_FIXED, so rendered frames match the device bit for
+// bit; show() only counts frames instead of driving a data line.
+
+#include <stdint.h>
+#include <string.h>
+
+inline uint8_t scale8(uint8_t i, uint8_t scale) {
+  return (uint8_t)(((uint16_t)i * (1 + (uint16_t)scale)) >> 8);
+}
+
+inline uint8_t scale8_video(uint8_t i, uint8_t scale) {
+  return (uint8_t)((((uint16_t)i * (uint16_t)scale) >> 8) + ((i && scale) ? 1 : 0));
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+  unsigned int t = i + j;
+  return t > 255 ? 255 : (uint8_t)t;
+}
+
+struct CRGB {
+  union {
+    struct {
+      uint8_t r;
+      uint8_t g;
+      uint8_t b;
+    };
+    uint8_t raw[3];
+  };
+
+  typedef enum {
+    Black = 0x000000,
+    White = 0xFFFFFF,
+    Red   = 0xFF0000,
+    Green = 0x008000,
+    Blue  = 0x0000FF
+  } HTMLColorCode;
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  CRGB(uint32_t colorcode)
+    : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+  CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+
+  uint8_t &operator[](uint8_t x) { return raw[x]; }
+  const uint8_t &operator[](uint8_t x) const { return raw[x]; }
+
+  CRGB &nscale8(uint8_t scaledown) {
+    r = scale8(r, scaledown);
+    g = scale8(g, scaledown);
+    b = scale8(b, scaledown);
+    return *this;
+  }
+
+  CRGB &nscale8_video(uint8_t scaledown) {
+    r = scale8_video(r, scaledown);
+    g = scale8_video(g, scaledown);
+    b = scale8_video(b, scaledown);
+    return *this;
+  }
+
+  CRGB &operator+=(const CRGB &rhs) {
+    r = qadd8(r, rhs.r);
+    g = qadd8(g, rhs.g);
+    b = qadd8(b, rhs.b);
+    return *this;
+  }
+};
+
+inline bool operator==(const CRGB &lhs, const CRGB &rhs) {
+  return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+inline bool operator!=(const CRGB &lhs, const CRGB &rhs) {
+  return !(lhs == rhs);
+}
+
+inline void fill_solid(struct CRGB *leds, int numToFill, const struct CRGB &color) {
+  for (int i = 0; i < numToFill; ++i) leds[i] = color;
+}
+
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class WS2812B {};
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class WS2812 {};
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class SK6812 {};
+
+class CLEDController {
+public:
+  CRGB *leds() { return _leds; }
+  int size() const { return _count; }
+
+  CRGB *_leds = nullptr;
+  int _count = 0;
+  uint8_t _pin = 0;
+};
+
+class CFastLED {
+public:
+  template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  CLEDController &addLeds(struct CRGB *data, int nLedsOrOffset, int nLedsIfOffset = 0) {
+    CLEDController &controller = _controllers[_numControllers < MAX_CONTROLLERS ? _numControllers++ : MAX_CONTROLLERS - 1];
+    int offset = nLedsIfOffset > 0 ? nLedsOrOffset : 0;
+    controller._leds = data + offset;
+    controller._count = nLedsIfOffset > 0 ? nLedsIfOffset : nLedsOrOffset;
+    controller._pin = DATA_PIN;
+    return controller;
+  }
+
+  void show() { _shows++; }
+
+  void clear(bool writeData = false) {
+    for (int i = 0; i < _numControllers; i++) {
+      memset((void *)_controllers[i]._leds, 0, sizeof(CRGB) * _controllers[i]._count);
+    }
+    if (writeData) show();
+  }
+
+  int count() const { return _numControllers; }
+  CLEDController &operator[](int x) { return _controllers[x]; }
+
+  // Number of show() calls so far; what the data line would have seen.
+  unsigned long nativeShowCount() const { return _shows; }
+
+  static const int MAX_CONTROLLERS = 8;
+
+private:
+  CLEDController _controllers[MAX_CONTROLLERS];
+  int _numControllers = 0;
+  unsigned long _shows = 0;
+};
+
+extern CFastLED FastLED;
+
+#endif // NATIVE_FASTLED_H
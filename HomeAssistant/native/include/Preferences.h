@@ -0,0 +1,40 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+// Host-side stand-in for the ESP32 NVS Preferences API, backed by an
+// in-memory map that lives for the duration of the process.
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end() {}
+
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putInt(const char *key, int32_t value);
+  int32_t getInt(const char *key, int32_t defaultValue = 0);
+
+  size_t putString(const char *key, const char *value);
+  size_t putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+  String getString(const char *key, const String &defaultValue = String());
+
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+
+  unsigned long nativeWriteCount() const { return _writes; }
+
+private:
+  std::string fullKey(const char *key) const;
+
+  std::string _namespace;
+  unsigned long _writes = 0;
+};
+
+#endif // NATIVE_PREFERENCES_H
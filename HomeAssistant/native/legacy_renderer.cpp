@@ -0,0 +1,214 @@
+// The beam renderer as it was before the beam profile and the specialized
+// draw loops: a float factor per pixel and the same block duplicated for
+// background on and off. Only built for the host benchmark, as the "before"
+// side of render_bench's comparison.
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <math.h>
+
+#include "config.h"
+#include "storage.h"
+
+void legacyRenderFrame(CRGB *out, int numLeds, unsigned int currentDistance, int diff,
+                       int lastMovementDirection, unsigned long currentMillis,
+                       unsigned long lastMovementTime) {
+  Serial.print("Distance: ");
+  Serial.print(currentDistance);
+  Serial.print(" | lastMovementTime: ");
+  Serial.println(lastMovementTime);
+
+  // Determine if we should draw the moving light beam based on the LED off delay
+  bool drawMovingPart = (currentMillis - lastMovementTime <= getLedOffDelay() * 1000);
+
+  // If light is off, clear the strip
+  if (!isLightOn()) {
+    fill_solid(out, numLeds, CRGB::Black);
+  }
+  else {
+    // If background mode is active, display the background glow regardless of motion
+    if (isBackgroundModeActive()) {
+      CRGB baseColor = getBaseColor();
+      float stationaryIntensity = getStationaryIntensity();
+
+      fill_solid(out, numLeds, CRGB(
+        (uint8_t)(baseColor.r * stationaryIntensity),
+        (uint8_t)(baseColor.g * stationaryIntensity),
+        (uint8_t)(baseColor.b * stationaryIntensity)
+      ));
+
+      // Overlay the moving light beam if motion is detected
+      if (drawMovingPart) {
+        float movingIntensity = getMovingIntensity();
+        int movingLength = getMovingLength();
+        int centerShift = getCenterShift();
+        int additionalLEDs = getAdditionalLEDs();
+
+        float prop = constrain((float)(currentDistance - MIN_DISTANCE) / (MAX_DISTANCE - MIN_DISTANCE), 0.0, 1.0);
+        int ledPosition = (diff < 0) ? ceil(prop * (numLeds - movingLength)) : round(prop * (numLeds - movingLength));
+        int centerLED = ledPosition + centerShift;
+        centerLED = constrain(centerLED, 0, numLeds - 1);
+        int halfLength = movingLength / 2;
+
+        if (movingLength <= 1) {
+          out[centerLED] = CRGB(
+            (uint8_t)(baseColor.r * movingIntensity),
+            (uint8_t)(baseColor.g * movingIntensity),
+            (uint8_t)(baseColor.b * movingIntensity)
+          );
+        } else {
+          int fadeWidthMain = min(halfLength, 5);
+
+          for (int offset = -halfLength; offset < halfLength; offset++) {
+            int idx = (centerLED + offset + numLeds) % numLeds;
+            int rIndex = offset + halfLength;
+            float factor = 1.0;
+
+            if (additionalLEDs == 0) {
+              if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
+                factor = (float)rIndex / (fadeWidthMain - 1);
+              } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
+                factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
+              }
+            } else {
+              if (lastMovementDirection > 0) { // Additional beam on the right: fade only on the left edge
+                if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
+                  factor = (float)rIndex / (fadeWidthMain - 1);
+                }
+              } else if (lastMovementDirection < 0) { // Additional beam on the left: fade only on the right edge
+                if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
+                  factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
+                }
+              } else {
+                if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
+                  factor = (float)rIndex / (fadeWidthMain - 1);
+                } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
+                  factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
+                }
+              }
+            }
+
+            out[idx] = CRGB(
+              (uint8_t)(baseColor.r * movingIntensity * factor),
+              (uint8_t)(baseColor.g * movingIntensity * factor),
+              (uint8_t)(baseColor.b * movingIntensity * factor)
+            );
+          }
+        }
+
+        if (lastMovementDirection != 0 && additionalLEDs > 0) {
+          int fadeWidthAdditional = min(additionalLEDs, 5);
+
+          for (int i = 0; i < additionalLEDs; i++) {
+            int idx = (lastMovementDirection > 0) ? centerLED + halfLength + i : centerLED - halfLength - i;
+
+            if (idx < 0 || idx >= numLeds) break;
+
+            float factor = 1.0;
+            if (additionalLEDs > 1) {
+              if (i >= additionalLEDs - fadeWidthAdditional) {
+                factor = (float)(additionalLEDs - 1 - i) / (fadeWidthAdditional - 1);
+              }
+            }
+
+            out[idx] = CRGB(
+              (uint8_t)(baseColor.r * movingIntensity * factor),
+              (uint8_t)(baseColor.g * movingIntensity * factor),
+              (uint8_t)(baseColor.b * movingIntensity * factor)
+            );
+          }
+        }
+      }
+    }
+    else {
+      // If background mode is off, display the moving light beam on a black background
+      if (drawMovingPart) {
+        fill_solid(out, numLeds, CRGB::Black);
+
+        CRGB baseColor = getBaseColor();
+        float movingIntensity = getMovingIntensity();
+        int movingLength = getMovingLength();
+        int centerShift = getCenterShift();
+        int additionalLEDs = getAdditionalLEDs();
+
+        float prop = constrain((float)(currentDistance - MIN_DISTANCE) / (MAX_DISTANCE - MIN_DISTANCE), 0.0, 1.0);
+        int ledPosition = (diff < 0) ? ceil(prop * (numLeds - movingLength)) : round(prop * (numLeds - movingLength));
+        int centerLED = ledPosition + centerShift;
+        centerLED = constrain(centerLED, 0, numLeds - 1);
+        int halfLength = movingLength / 2;
+
+        if (movingLength <= 1) {
+          out[centerLED] = CRGB(
+            (uint8_t)(baseColor.r * movingIntensity),
+            (uint8_t)(baseColor.g * movingIntensity),
+            (uint8_t)(baseColor.b * movingIntensity)
+          );
+        } else {
+          int fadeWidthMain = min(halfLength, 5);
+
+          for (int offset = -halfLength; offset < halfLength; offset++) {
+            int idx = (centerLED + offset + numLeds) % numLeds;
+            int rIndex = offset + halfLength;
+            float factor = 1.0;
+
+            if (additionalLEDs == 0) {
+              if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
+                factor = (float)rIndex / (fadeWidthMain - 1);
+              } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
+                factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
+              }
+            } else {
+              if (lastMovementDirection > 0) {
+                if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
+                  factor = (float)rIndex / (fadeWidthMain - 1);
+                }
+              } else if (lastMovementDirection < 0) {
+                if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
+                  factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
+                }
+              } else {
+                if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
+                  factor = (float)rIndex / (fadeWidthMain - 1);
+                } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
+                  factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
+                }
+              }
+            }
+
+            out[idx] = CRGB(
+              (uint8_t)(baseColor.r * movingIntensity * factor),
+              (uint8_t)(baseColor.g * movingIntensity * factor),
+              (uint8_t)(baseColor.b * movingIntensity * factor)
+            );
+          }
+        }
+
+        if (lastMovementDirection != 0 && additionalLEDs > 0) {
+          int fadeWidthAdditional = min(additionalLEDs, 5);
+
+          for (int i = 0; i < additionalLEDs; i++) {
+            int idx = (lastMovementDirection > 0) ? centerLED + halfLength + i : centerLED - halfLength - i;
+
+            if (idx < 0 || idx >= numLeds) break;
+
+            float factor = 1.0;
+            if (additionalLEDs > 1) {
+              if (i >= additionalLEDs - fadeWidthAdditional) {
+                factor = (float)(additionalLEDs - 1 - i) / (fadeWidthAdditional - 1);
+              }
+            }
+
+            out[idx] = CRGB(
+              (uint8_t)(baseColor.r * movingIntensity * factor),
+              (uint8_t)(baseColor.g * movingIntensity * factor),
+              (uint8_t)(baseColor.b * movingIntensity * factor)
+            );
+          }
+        }
+      }
+      else {
+        fill_solid(out, numLeds, CRGB::Black);
+      }
+    }
+  }
+}
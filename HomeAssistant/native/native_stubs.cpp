@@ -0,0 +1,237 @@
+// Implementations behind the host-side Arduino/FastLED/EEPROM/Preferences
+// stand-ins in native/include. Only built by [env:native].
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <EEPROM.h>
+#include <Preferences.h>
+#include <stdarg.h>
+#include <map>
+
+// ------------------------- Clock and FreeRTOS -------------------------
+
+static unsigned long simulatedMicros = 0;
+
+unsigned long millis() { return simulatedMicros / 1000; }
+unsigned long micros() { return simulatedMicros; }
+void delay(unsigned long ms) { nativeAdvanceMillis(ms); }
+void nativeAdvanceMillis(unsigned long ms) { simulatedMicros += ms * 1000; }
+
+void vTaskDelay(TickType_t ticks) { nativeAdvanceMillis(ticks * portTICK_PERIOD_MS); }
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t timeIncrement) {
+  TickType_t wakeTime = *previousWakeTime + timeIncrement;
+  TickType_t now = xTaskGetTickCount();
+  if ((int32_t)(wakeTime - now) > 0) vTaskDelay(wakeTime - now);
+  *previousWakeTime = wakeTime;
+}
+TickType_t xTaskGetTickCount() { return (TickType_t)(millis() / portTICK_PERIOD_MS); }
+
+static int currentTask;
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return &currentTask; }
+BaseType_t xTaskNotify(TaskHandle_t, uint32_t, eNotifyAction) { return pdPASS; }
+BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t ticksToWait) {
+  if (ticksToWait != portMAX_DELAY) vTaskDelay(ticksToWait);
+  return 0;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t, uint32_t, uint32_t *, TickType_t ticksToWait) {
+  if (ticksToWait != portMAX_DELAY) vTaskDelay(ticksToWait);
+  return pdFALSE;
+}
+
+// ------------------------- String -------------------------
+
+static std::string formatInteger(unsigned long value, bool negative, unsigned char base) {
+  char buf[8 * sizeof(long) + 2];
+  char *p = buf + sizeof(buf) - 1;
+  *p = '\0';
+  if (base < 2) base = 10;
+  do {
+    unsigned digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value);
+  if (negative) *--p = '-';
+  return std::string(p);
+}
+
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+String::String(long value, unsigned char base)
+  : std::string(base == DEC && value < 0 ? formatInteger(-(unsigned long)value, true, base)
+                                         : formatInteger((unsigned long)value, false, base)) {}
+String::String(unsigned long value, unsigned char base) : std::string(formatInteger(value, false, base)) {}
+String::String(float value, unsigned int decimalPlaces) : String((double)value, decimalPlaces) {}
+String::String(double value, unsigned int decimalPlaces) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimalPlaces, value);
+  assign(buf);
+}
+
+// ------------------------- Serial -------------------------
+
+static bool serialEcho = false;
+static NativeSerialSink serialSink = NULL;
+
+void nativeSerialEcho(bool enabled) { serialEcho = enabled; }
+void nativeSerialCapture(NativeSerialSink sink) { serialSink = sink; }
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+
+void HardwareSerial::begin(unsigned long, uint32_t, int8_t, int8_t) { nativeFlushRx(); }
+
+int HardwareSerial::available() { return (int)_rxCount; }
+
+int HardwareSerial::read() {
+  if (_rxCount == 0) return -1;
+  uint8_t c = _rx[_rxHead];
+  _rxHead = (_rxHead + 1) % RX_BUFFER_SIZE;
+  _rxCount--;
+  return c;
+}
+
+int HardwareSerial::peek() { return _rxCount ? _rx[_rxHead] : -1; }
+
+// The simulated UART never waits: a short read returns what is queued,
+// exactly like the real readBytes() after its timeout expires.
+size_t HardwareSerial::readBytes(uint8_t *buffer, size_t length) {
+  size_t n = 0;
+  while (n < length && _rxCount) buffer[n++] = (uint8_t)read();
+  return n;
+}
+
+size_t HardwareSerial::nativeFeed(const uint8_t *data, size_t length) {
+  size_t n = 0;
+  while (n < length && _rxCount < RX_BUFFER_SIZE) {
+    _rx[(_rxHead + _rxCount) % RX_BUFFER_SIZE] = data[n++];
+    _rxCount++;
+  }
+  if (n && _onReceive) _onReceive();
+  return n;
+}
+
+void HardwareSerial::nativeFlushRx() {
+  _rxHead = 0;
+  _rxCount = 0;
+}
+
+size_t HardwareSerial::emit(const char *s, size_t length) {
+  if (serialEcho && _port == 0) fwrite(s, 1, length, stdout);
+  if (serialSink && _port == 0) serialSink(s, length);
+  return length;
+}
+
+size_t HardwareSerial::write(uint8_t c) { return emit((const char *)&c, 1); }
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) { return emit((const char *)buffer, size); }
+
+size_t HardwareSerial::printf(const char *format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  return emit(buf, std::min((size_t)len, sizeof(buf) - 1));
+}
+
+size_t HardwareSerial::print(const char *s) { return emit(s, strlen(s)); }
+size_t HardwareSerial::print(char c) { return emit(&c, 1); }
+
+size_t HardwareSerial::print(long value, int base) {
+  if (base != DEC) return print((unsigned long)value, base);
+  return printf("%ld", value);
+}
+
+size_t HardwareSerial::print(unsigned long value, int base) {
+  if (base == HEX) return printf("%lX", value);
+  return printf("%lu", value);
+}
+
+size_t HardwareSerial::print(int value, int base) { return print((long)value, base); }
+size_t HardwareSerial::print(unsigned int value, int base) { return print((unsigned long)value, base); }
+size_t HardwareSerial::print(double value, int digits) { return printf("%.*f", digits, value); }
+
+// ------------------------- FastLED -------------------------
+
+CFastLED FastLED;
+
+// ------------------------- EEPROM -------------------------
+
+EEPROMClass EEPROM;
+
+bool EEPROMClass::begin(size_t size) {
+  if (size > MAX_SIZE) return false;
+  if (!_initialized) {
+    memset(_data, 0, sizeof(_data));
+    _initialized = true;
+  }
+  _size = size;
+  return true;
+}
+
+// ------------------------- Preferences -------------------------
+
+static std::map<std::string, std::string> &nvsStore() {
+  static std::map<std::string, std::string> store;
+  return store;
+}
+
+std::string Preferences::fullKey(const char *key) const { return _namespace + "/" + key; }
+
+bool Preferences::begin(const char *name, bool) {
+  _namespace = name;
+  return true;
+}
+
+bool Preferences::clear() {
+  std::string prefix = _namespace + "/";
+  auto &store = nvsStore();
+  for (auto it = store.begin(); it != store.end();) {
+    it = it->first.compare(0, prefix.size(), prefix) == 0 ? store.erase(it) : std::next(it);
+  }
+  return true;
+}
+
+bool Preferences::remove(const char *key) { return nvsStore().erase(fullKey(key)) > 0; }
+bool Preferences::isKey(const char *key) { return nvsStore().count(fullKey(key)) > 0; }
+
+size_t Preferences::putInt(const char *key, int32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char *key, int32_t defaultValue) {
+  int32_t value = defaultValue;
+  if (getBytesLength(key) == sizeof(value)) getBytes(key, &value, sizeof(value));
+  return value;
+}
+
+size_t Preferences::putString(const char *key, const char *value) {
+  return putBytes(key, value, strlen(value));
+}
+
+String Preferences::getString(const char *key, const String &defaultValue) {
+  auto it = nvsStore().find(fullKey(key));
+  return it == nvsStore().end() ? defaultValue : String(it->second);
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  nvsStore()[fullKey(key)].assign((const char *)value, len);
+  _writes++;
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  auto it = nvsStore().find(fullKey(key));
+  return it == nvsStore().end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  auto it = nvsStore().find(fullKey(key));
+  if (it == nvsStore().end() || it->second.size() > maxLen) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
@@ -0,0 +1,205 @@
+// Frame-render benchmark for the host build ([env:native]).
+//
+// Drives the firmware's sensor parser and updateLEDFrame() with a scripted
+// walker going back and forth along the strip and reports, for each render
+// path, the mean CPU time per frame, heap allocations per frame and how many
+// frames were actually pushed to the strip, for strips of 300, 1000 and
+// 3000 LEDs (set through the LED count setting, as on the device).
+//
+// Each scenario is also run through legacyRenderFrame(), the original
+// float-per-pixel renderer, as a before/after reference.
+
+// Left out of the test builds, which bring their own main()
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <chrono>
+#include <new>
+
+#include "config.h"
+#include "led_controller.h"
+#include "log.h"
+#include "sensor_manager.h"
+#include "storage.h"
+
+// legacy_renderer.cpp
+void legacyRenderFrame(CRGB *out, int numLeds, unsigned int currentDistance, int diff,
+                       int lastMovementDirection, unsigned long currentMillis,
+                       unsigned long lastMovementTime);
+
+// ------------------------- Allocation counting -------------------------
+
+static bool countAllocations = false;
+static unsigned long allocationCount = 0;
+
+void *operator new(size_t size) {
+  if (countAllocations) allocationCount++;
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// ------------------------- Scripted sensor input -------------------------
+
+// Queue one sensor frame (0xAA 0xAA, then distance little-endian in bytes
+// 3..4 and a checksum in the last byte) and let the parser pick it up the
+// way sensorTask does.
+static void feedDistance(unsigned int distance) {
+  uint8_t frame[SENSOR_FRAME_LENGTH] = {
+    SENSOR_HEADER, SENSOR_HEADER, 0x00,
+    (uint8_t)(distance & 0xFF), (uint8_t)(distance >> 8)
+  };
+  uint8_t sum = 0;
+  for (int i = 2; i < SENSOR_FRAME_LENGTH - 1; i++) sum += frame[i];
+  frame[SENSOR_FRAME_LENGTH - 1] = sum;
+  Serial1.nativeFeed(frame, sizeof(frame));
+  processSensorData();
+}
+
+// Walker moving back and forth between MIN_DISTANCE and MAX_DISTANCE.
+static unsigned int walkerDistance(unsigned long frame) {
+  const unsigned int step = 7;
+  const unsigned int span = MAX_DISTANCE - MIN_DISTANCE;
+  unsigned int travelled = (frame * step) % (2 * span);
+  return MIN_DISTANCE + (travelled <= span ? travelled : 2 * span - travelled);
+}
+
+// ------------------------- Benchmark -------------------------
+
+struct Scenario {
+  const char *name;
+  bool backgroundMode;
+  float stationaryIntensity;
+  int additionalLEDs;
+  bool walking;
+};
+
+static void applyScenario(const Scenario &scenario) {
+  // Start from the firmware defaults rather than whatever EEPROM holds
+  setUpdateInterval(DEFAULT_UPDATE_INTERVAL);
+  setLedOffDelay(DEFAULT_LED_OFF_DELAY);
+  setMovingIntensity(DEFAULT_MOVING_INTENSITY);
+  setMovingLength(DEFAULT_MOVING_LENGTH);
+  setCenterShift(DEFAULT_CENTER_SHIFT);
+  setBaseColor(DEFAULT_BASE_COLOR);
+
+  setLightOn(true);
+  setBackgroundModeActive(scenario.backgroundMode);
+  setStationaryIntensity(scenario.stationaryIntensity);
+  setAdditionalLEDs(scenario.additionalLEDs);
+}
+
+static void runScenario(const Scenario &scenario, unsigned long frames) {
+  applyScenario(scenario);
+
+  // Warm up so the beam is on and direction state is settled
+  for (unsigned long i = 0; i < 64; i++) {
+    feedDistance(walkerDistance(i));
+    updateLEDFrame();
+    nativeAdvanceMillis(getUpdateInterval());
+  }
+
+  unsigned long long totalNs = 0;
+  unsigned long showsBefore = FastLED.nativeShowCount();
+  allocationCount = 0;
+
+  for (unsigned long i = 0; i < frames; i++) {
+    feedDistance(scenario.walking ? walkerDistance(i) : walkerDistance(0));
+
+    countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    updateLEDFrame();
+    auto end = std::chrono::steady_clock::now();
+    countAllocations = false;
+
+    totalNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    nativeAdvanceMillis(getUpdateInterval());
+  }
+
+  printf("%-16s %6d %12.0f %14.3f %10lu\n",
+         scenario.name, getLedCount(),
+         (double)totalNs / frames,
+         (double)allocationCount / frames,
+         FastLED.nativeShowCount() - showsBefore);
+}
+
+// The original renderer, fed the raw distance and its own noise-threshold
+// motion detection as it was in ledTask; it pushed every frame.
+static void runLegacyScenario(const Scenario &scenario, unsigned long frames) {
+  static CRGB out[MAX_NUM_LEDS];
+  applyScenario(scenario);
+
+  unsigned int lastSensor = walkerDistance(0);
+  int lastMovementDirection = 0;
+  unsigned long lastMovementTime = millis();
+  unsigned long long totalNs = 0;
+  allocationCount = 0;
+
+  for (unsigned long i = 0; i < frames; i++) {
+    unsigned int distance = scenario.walking ? walkerDistance(i) : walkerDistance(0);
+    unsigned long now = millis();
+    int diff = (int)distance - (int)lastSensor;
+    if (abs(diff) >= NOISE_THRESHOLD) {
+      lastMovementTime = now;
+      lastMovementDirection = (diff > 0) ? 1 : -1;
+    }
+    lastSensor = distance;
+
+    countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    legacyRenderFrame(out, getLedCount(), distance, diff, lastMovementDirection, now, lastMovementTime);
+    auto end = std::chrono::steady_clock::now();
+    countAllocations = false;
+
+    totalNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    nativeAdvanceMillis(getUpdateInterval());
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "%s (old)", scenario.name);
+  printf("%-16s %6d %12.0f %14.3f %10lu\n",
+         name, getLedCount(),
+         (double)totalNs / frames,
+         (double)allocationCount / frames,
+         frames);
+}
+
+int main(int argc, char **argv) {
+  unsigned long frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+
+  initLog();
+  initStorage();
+  initSensor();
+
+  const Scenario scenarios[] = {
+    { "beam",       false, 0.0f,  0,  true },
+    { "beam+tail",  false, 0.0f,  10, true },
+    { "background", true,  0.05f, 0,  true },
+    { "static",     true,  0.05f, 0,  false },
+  };
+
+  const int stripLengths[] = { 300, 1000, 3000 };
+
+  printf("%-16s %6s %12s %14s %10s\n", "path", "leds", "ns/frame", "allocs/frame", "shows");
+  for (int length : stripLengths) {
+    if (length > MAX_NUM_LEDS) continue;
+    setNumLeds(length);
+    initLEDController();
+
+    for (const Scenario &scenario : scenarios) {
+      runScenario(scenario, frames);
+    }
+    for (const Scenario &scenario : scenarios) {
+      runLegacyScenario(scenario, frames);
+    }
+  }
+  return 0;
+}
+#endif // PIO_UNIT_TESTING
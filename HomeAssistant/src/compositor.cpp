@@ -0,0 +1,147 @@
+#include "compositor.h"
+#include "config.h"
+
+static Layer *layers[COMPOSITOR_MAX_LAYERS];
+static int layerCount = 0;
+
+static CRGB *frame = NULL;
+static int frameLength = 0;
+static bool fullRedraw = true;
+
+void initCompositor(CRGB *target, int numLeds) {
+  frame = target;
+  frameLength = numLeds;
+  layerCount = 0;
+  fullRedraw = true;
+}
+
+bool addLayer(Layer &layer) {
+  if (layerCount >= COMPOSITOR_MAX_LAYERS) {
+    return false;
+  }
+  layer.changed = true;
+  layer.drawnVisible = false;
+  layer.drawnSpan = { 0, 0 };
+  layers[layerCount++] = &layer;
+  return true;
+}
+
+void placeLayer(Layer &layer, bool visible, PixelSpan span) {
+  int start = max(span.start, 0);
+  int end = min(span.start + span.length, frameLength);
+  span = { start, max(end - start, 0) };
+  if (span.length == 0) {
+    visible = false;
+  }
+
+  if (visible != layer.visible ||
+      (visible && (span.start != layer.span.start || span.length != layer.span.length))) {
+    layer.changed = true;
+  }
+  layer.visible = visible;
+  layer.span = span;
+}
+
+void markLayerChanged(Layer &layer) {
+  layer.changed = true;
+}
+
+void invalidateFrame() {
+  fullRedraw = true;
+}
+
+static void blendPixels(CRGB *dst, const CRGB *src, int count, BlendMode mode) {
+  switch (mode) {
+    case BLEND_REPLACE:
+      memcpy(dst, src, count * sizeof(CRGB));
+      break;
+    case BLEND_ADD:
+      for (int i = 0; i < count; i++) {
+        dst[i] += src[i];
+      }
+      break;
+    case BLEND_MAX:
+      for (int i = 0; i < count; i++) {
+        dst[i].r = max(dst[i].r, src[i].r);
+        dst[i].g = max(dst[i].g, src[i].g);
+        dst[i].b = max(dst[i].b, src[i].b);
+      }
+      break;
+  }
+}
+
+// Rebuild [start, end) from all visible layers, bottom to top. Layers that
+// blend are rendered through a small scratch buffer, a chunk at a time, so
+// the compositor needs no second frame buffer.
+static void composeRange(int start, int end) {
+  CRGB scratch[COMPOSITOR_CHUNK];
+
+  for (int chunk = start; chunk < end; chunk += COMPOSITOR_CHUNK) {
+    int chunkEnd = min(chunk + COMPOSITOR_CHUNK, end);
+    fill_solid(frame + chunk, chunkEnd - chunk, CRGB::Black);
+
+    for (int i = 0; i < layerCount; i++) {
+      const Layer &layer = *layers[i];
+      if (!layer.visible) continue;
+
+      int from = max(chunk, layer.span.start);
+      int to = min(chunkEnd, layer.span.start + layer.span.length);
+      if (from >= to) continue;
+
+      if (layer.blend == BLEND_REPLACE) {
+        layer.render(layer, frame + from, from, to - from);
+      } else {
+        layer.render(layer, scratch, from, to - from);
+        blendPixels(frame + from, scratch, to - from, layer.blend);
+      }
+    }
+  }
+}
+
+static void addDamage(PixelSpan *damage, int &count, const PixelSpan &span) {
+  if (span.length <= 0) return;
+  // Keep the list sorted by start so overlapping ranges can be merged in one pass
+  int i = count++;
+  while (i > 0 && damage[i - 1].start > span.start) {
+    damage[i] = damage[i - 1];
+    i--;
+  }
+  damage[i] = span;
+}
+
+bool composeFrame() {
+  PixelSpan damage[2 * COMPOSITOR_MAX_LAYERS + 1];
+  int damageCount = 0;
+
+  if (fullRedraw) {
+    addDamage(damage, damageCount, { 0, frameLength });
+  } else {
+    for (int i = 0; i < layerCount; i++) {
+      const Layer &layer = *layers[i];
+      if (!layer.changed) continue;
+      if (layer.drawnVisible) addDamage(damage, damageCount, layer.drawnSpan);
+      if (layer.visible) addDamage(damage, damageCount, layer.span);
+    }
+  }
+
+  for (int i = 0; i < layerCount; i++) {
+    Layer &layer = *layers[i];
+    layer.changed = false;
+    layer.drawnVisible = layer.visible;
+    layer.drawnSpan = layer.span;
+  }
+  fullRedraw = false;
+
+  // Merge overlapping or touching ranges, then redraw each once
+  int i = 0;
+  while (i < damageCount) {
+    int start = damage[i].start;
+    int end = start + damage[i].length;
+    for (i++; i < damageCount && damage[i].start <= end; i++) {
+      end = max(end, damage[i].start + damage[i].length);
+    }
+    composeRange(start, end);
+  }
+
+  return damageCount > 0;
+}
@@ -0,0 +1,65 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// How a layer's pixels combine with what the layers below it produced
+enum BlendMode {
+  BLEND_REPLACE,   // overwrite
+  BLEND_ADD,       // per-channel saturating add
+  BLEND_MAX        // per-channel maximum
+};
+
+// Pixels [start, start + length) of the strip
+struct PixelSpan {
+  int start;
+  int length;
+};
+
+struct Layer;
+
+// Write the layer's pixels for strip positions [start, start + count) to
+// out[0 .. count). Only called for positions inside the layer's span.
+typedef void (*LayerRenderFn)(const Layer &layer, CRGB *out, int start, int count);
+
+// One effect in the frame (background glow, beam, tail, ...). The owner
+// positions it with placeLayer() and calls markLayerChanged() when its
+// content changes; the compositor then redraws only the pixels the layer
+// covered before or covers now, so a static layer costs nothing per frame.
+struct Layer {
+  const char *name;
+  BlendMode blend;
+  LayerRenderFn render;
+  void *context;
+
+  // Current placement
+  bool visible;
+  PixelSpan span;
+
+  // Compositor bookkeeping
+  bool changed;
+  bool drawnVisible;
+  PixelSpan drawnSpan;
+};
+
+// Composite into frame[0 .. numLeds)
+void initCompositor(CRGB *frame, int numLeds);
+
+// Add a layer on top of the existing ones; returns false when full
+bool addLayer(Layer &layer);
+
+// Show or hide a layer and set the pixels it covers (clipped to the strip)
+void placeLayer(Layer &layer, bool visible, PixelSpan span);
+
+// The layer's content changed without moving
+void markLayerChanged(Layer &layer);
+
+// Redraw the whole frame on the next composeFrame()
+void invalidateFrame();
+
+// Recompose the pixels touched by changed layers.
+// Returns false when nothing changed since the previous call.
+bool composeFrame();
+
+#endif // COMPOSITOR_H
@@ -2,10 +2,14 @@
 #include "config.h"
 #include "storage.h"
 #include "wifi_manager.h"
+#include "led_controller.h"
+#include "log.h"
 #include <WiFi.h>
 #include <WiFiClient.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <atomic>
+#include <limits.h>
 
 // MQTT client
 WiFiClient wifiClient;
@@ -15,7 +19,26 @@ PubSubClient mqttClient(wifiClient);
 bool mqttEnabled = false;
 char mqttClientId[50];
 unsigned long lastMqttReconnectAttempt = 0;
-unsigned long lastHADiscoveryTime = 0;
+
+// State publishing is driven by the settings' change mask. Changes are
+// collected in pendingState and published at most once per
+// MQTT_PUBLISH_WINDOW; a publish identical to the last one (a command that
+// set a value it already had) is skipped.
+#define MQTT_STATE_FIELDS (~(uint32_t)SETTING_SCHEDULE)   // the schedule is not in the state
+static uint32_t pendingState = 0;
+static unsigned long lastStatePublish = 0;
+static uint32_t lastStateHash = 0;
+
+// Connection and publish counters, read by the /metrics handler
+static std::atomic<uint32_t> mqttConnects(0);
+static std::atomic<uint32_t> mqttConnectFailures(0);
+static std::atomic<uint32_t> mqttPublishFailures(0);
+static std::atomic<bool> mqttConnected(false);
+
+// Set by requestMqttReconnect() on other tasks; the client itself is only
+// driven from the task that runs handleHomeAssistant()
+static std::atomic<bool> mqttReconnectRequested(false);
+static TaskHandle_t mqttTask = NULL;
 
 // MQTT topics
 String baseTopic;
@@ -28,6 +51,7 @@ bool reconnectMqtt();
 void sendHomeAssistantDiscovery();
 void publishState();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
+bool publishMqtt(const char *topic, const char *payload, bool retained);
 
 void initHomeAssistant() {
   // Create client ID from device name
@@ -41,6 +65,15 @@ void initHomeAssistant() {
   commandTopic = baseTopic + "/set";
   availabilityTopic = baseTopic + "/availability";
   
+  // handleHomeAssistant() runs on this task
+  mqttTask = xTaskGetCurrentTaskHandle();
+  
+  // The state and discovery payloads are larger than PubSubClient's default
+  // 256-byte packet buffer, which makes publish() fail
+  if (!mqttClient.setBufferSize(MQTT_BUFFER_SIZE)) {
+    LOG_ERROR("MQTT buffer of %u bytes could not be allocated", MQTT_BUFFER_SIZE);
+  }
+  
   // Используем сохраненные настройки MQTT или дефолтные
   // Для прямой работы с MQTT без WiFi можно закомментировать проверку
   if (hasMqttSettings()) {
@@ -48,17 +81,31 @@ void initHomeAssistant() {
   }
 }
 
-void handleHomeAssistant() {
+unsigned long handleHomeAssistant() {
+  // New settings saved from the web UI: drop the old connection and connect
+  // with them here rather than on the web server's task
+  if (mqttReconnectRequested.exchange(false)) {
+    if (mqttClient.connected()) {
+      // A clean disconnect doesn't send the will; mark the device offline
+      publishMqtt(availabilityTopic.c_str(), "offline", true);
+      mqttClient.disconnect();
+    }
+    lastMqttReconnectAttempt = 0;
+    setMqttServer(getMqttServer());
+  }
+  
   // Если не включен MQTT или нет настроек - просто выходим
   if (!mqttEnabled || !hasMqttSettings()) {
-    return;
+    return ULONG_MAX;
   }
   
   // В режиме AP подключение WiFi всегда будет не WL_CONNECTED, поэтому закомментируем эту проверку
   // if (WiFi.status() != WL_CONNECTED) return;
   
   // Handle reconnection if needed
-  if (!mqttClient.connected()) {
+  bool connected = mqttClient.connected();
+  mqttConnected.store(connected, std::memory_order_relaxed);
+  if (!connected) {
     unsigned long now = millis();
     if (now - lastMqttReconnectAttempt > MQTT_RECONNECT_DELAY) {
       lastMqttReconnectAttempt = now;
@@ -67,17 +114,20 @@ void handleHomeAssistant() {
       }
     }
   } else {
-    // MQTT client loop
+    // MQTT client loop; commands received here change settings, which
+    // shows up in the change mask on the next call
     mqttClient.loop();
-    
-    // Send discovery information periodically
-    unsigned long now = millis();
-    if (now - lastHADiscoveryTime > HA_DISCOVERY_DELAY) {
-      lastHADiscoveryTime = now;
-      sendHomeAssistantDiscovery();
+
+    pendingState |= takeStateChanges() & MQTT_STATE_FIELDS;
+    if (pendingState != 0) {
+      unsigned long sinceLast = millis() - lastStatePublish;
+      if (sinceLast < MQTT_PUBLISH_WINDOW) {
+        return MQTT_PUBLISH_WINDOW - sinceLast;
+      }
       publishState();
     }
   }
+  return ULONG_MAX;
 }
 
 bool reconnectMqtt() {
@@ -93,9 +143,7 @@ bool reconnectMqtt() {
   mqttClient.setServer(mqttServer.c_str(), mqttPort);
   mqttClient.setCallback(mqttCallback);
   
-  Serial.print("Attempting MQTT connection to ");
-  Serial.print(mqttServer);
-  Serial.print("...");
+  LOG_INFO("Attempting MQTT connection to %s", mqttServer);
   
   bool success = false;
   
@@ -107,28 +155,59 @@ bool reconnectMqtt() {
   }
   
   if (success) {
-    Serial.println("connected");
+    LOG_INFO("MQTT connected");
+    mqttConnects.fetch_add(1, std::memory_order_relaxed);
     
     // Publish online status
-    mqttClient.publish(availabilityTopic.c_str(), "online", true);
+    publishMqtt(availabilityTopic.c_str(), "online", true);
     
-    // Subscribe to command topic
+    // Subscribe to command topic, and to HomeAssistant's status so a
+    // restarted HomeAssistant gets the (retained) discovery again
     mqttClient.subscribe(commandTopic.c_str());
+    mqttClient.subscribe(HA_STATUS_TOPIC);
     
     // Send discovery information
     sendHomeAssistantDiscovery();
     
-    // Publish state
+    // Publish the full state, whether or not it changed while disconnected
+    lastStateHash = 0;
     publishState();
     
     return true;
   } else {
-    Serial.print("failed, rc=");
-    Serial.println(mqttClient.state());
+    LOG_WARN("MQTT connection failed, rc=%d", mqttClient.state());
+    mqttConnectFailures.fetch_add(1, std::memory_order_relaxed);
     return false;
   }
 }
 
+// Publish and count (and log) the messages PubSubClient could not send
+bool publishMqtt(const char *topic, const char *payload, bool retained) {
+  if (!mqttClient.publish(topic, payload, retained)) {
+    mqttPublishFailures.fetch_add(1, std::memory_order_relaxed);
+    LOG_EVERY(LOG_LEVEL_WARN, 5000, "MQTT publish to %s failed (%u bytes)",
+              topic, (unsigned)strlen(payload));
+    return false;
+  }
+  return true;
+}
+
+MqttStats getMqttStats() {
+  MqttStats stats;
+  stats.connects = mqttConnects.load(std::memory_order_relaxed);
+  stats.connectFailures = mqttConnectFailures.load(std::memory_order_relaxed);
+  stats.publishFailures = mqttPublishFailures.load(std::memory_order_relaxed);
+  stats.connected = mqttConnected.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void requestMqttReconnect() {
+  mqttReconnectRequested.store(true);
+  if (mqttTask != NULL) {
+    xTaskNotifyGive(mqttTask);
+  }
+}
+
 void setMqttServer(String server) {
   mqttEnabled = server.length() > 0;
   
@@ -159,7 +238,7 @@ void createNumberEntity(JsonDocument& deviceDoc, String name, String field, floa
   serializeJson(entityDoc, entityJson);
   
   String entityTopic = String(MQTT_DISCOVERY_PREFIX) + "/number/" + deviceName + "_" + field + "/config";
-  mqttClient.publish(entityTopic.c_str(), entityJson.c_str(), true);
+  publishMqtt(entityTopic.c_str(), entityJson.c_str(), true);
 }
 
 void sendHomeAssistantDiscovery() {
@@ -170,7 +249,7 @@ void sendHomeAssistantDiscovery() {
   String deviceName = getDeviceName();
   deviceName.replace(" ", "_");
   
-  Serial.println("Sending HomeAssistant discovery information...");
+  LOG_INFO("Sending HomeAssistant discovery information...");
   
   DynamicJsonDocument deviceDoc(256);
   deviceDoc["identifiers"] = deviceName;
@@ -195,7 +274,7 @@ void sendHomeAssistantDiscovery() {
   serializeJson(lightDoc, lightJson);
   
   String discoveryTopic = String(MQTT_DISCOVERY_PREFIX) + "/light/" + deviceName + "/config";
-  mqttClient.publish(discoveryTopic.c_str(), lightJson.c_str(), true);
+  publishMqtt(discoveryTopic.c_str(), lightJson.c_str(), true);
   
   // Background mode switch
   DynamicJsonDocument backgroundDoc(512);
@@ -213,16 +292,18 @@ void sendHomeAssistantDiscovery() {
   serializeJson(backgroundDoc, backgroundJson);
   
   String backgroundTopic = String(MQTT_DISCOVERY_PREFIX) + "/switch/" + deviceName + "_background/config";
-  mqttClient.publish(backgroundTopic.c_str(), backgroundJson.c_str(), true);
+  publishMqtt(backgroundTopic.c_str(), backgroundJson.c_str(), true);
   
   // Create number entities for other parameters
-  createNumberEntity(deviceDoc, "Moving Length", "moving_length", 1, 300, 1);
+  createNumberEntity(deviceDoc, "Moving Length", "moving_length", 1, getLedCount(), 1);
   createNumberEntity(deviceDoc, "Center Shift", "center_shift", -100, 100, 1);
   createNumberEntity(deviceDoc, "Additional LEDs", "additional_leds", 0, 100, 1);
   createNumberEntity(deviceDoc, "LED Off Delay", "led_off_delay", 1, 60, 1);
   createNumberEntity(deviceDoc, "Update Interval", "update_interval", 5, 100, 1);
+  createNumberEntity(deviceDoc, "Prediction Lead", "speed_multiplier", 0, MAX_SPEED_MULTIPLIER, 0.1);
   createNumberEntity(deviceDoc, "Moving Intensity", "moving_intensity", 0, 1, 0.01);
   createNumberEntity(deviceDoc, "Background Intensity", "stationary_intensity", 0, 0.07, 0.001);
+  createNumberEntity(deviceDoc, "LED Count", "num_leds", 1, MAX_NUM_LEDS, 1);
 }
 
 void publishState() {
@@ -247,13 +328,30 @@ void publishState() {
   stateDoc["additional_leds"] = getAdditionalLEDs();
   stateDoc["led_off_delay"] = getLedOffDelay();
   stateDoc["update_interval"] = getUpdateInterval();
+  stateDoc["speed_multiplier"] = getSpeedMultiplier();
   stateDoc["moving_intensity"] = getMovingIntensity();
   stateDoc["stationary_intensity"] = getStationaryIntensity();
+  stateDoc["num_leds"] = getNumLeds();
   
   String stateJson;
   serializeJson(stateDoc, stateJson);
-  
-  mqttClient.publish(stateTopic.c_str(), stateJson.c_str(), true);
+
+  // The topic is retained and read by every entity's template, so each
+  // message carries the whole state; identical ones are not sent again
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < stateJson.length(); i++) {
+    hash = (hash ^ (uint8_t)stateJson[i]) * 16777619UL;
+  }
+  if (hash == lastStateHash) {
+    pendingState = 0;
+    return;
+  }
+  // A failed publish stays pending and is retried after the window
+  lastStatePublish = millis();
+  if (publishMqtt(stateTopic.c_str(), stateJson.c_str(), true)) {
+    lastStateHash = hash;
+    pendingState = 0;
+  }
 }
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
@@ -264,32 +362,33 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
   }
   message[length] = '\0';
   
-  Serial.print("Message arrived [");
-  Serial.print(topic);
-  Serial.print("] ");
-  Serial.println(message);
+  LOG_EVERY(LOG_LEVEL_DEBUG, 1000, "Message arrived [%s] %s", topic, message);
+
+  if (strcmp(topic, HA_STATUS_TOPIC) == 0) {
+    if (strcmp(message, "online") == 0) {
+      sendHomeAssistantDiscovery();
+      lastStateHash = 0;
+      pendingState |= MQTT_STATE_FIELDS;
+    }
+    return;
+  }
   
   // Process command
   DynamicJsonDocument doc(512);
   DeserializationError error = deserializeJson(doc, message);
   
   if (error) {
-    Serial.print("deserializeJson() failed: ");
-    Serial.println(error.c_str());
+    LOG_WARN("deserializeJson() failed: %s", error.c_str());
     return;
   }
   
-  bool stateChanged = false;
-  
   // Process state
   if (doc.containsKey("state")) {
     String state = doc["state"].as<String>();
     if (state == "ON") {
       setLightOn(true);
-      stateChanged = true;
     } else if (state == "OFF") {
       setLightOn(false);
-      stateChanged = true;
     }
   }
   
@@ -299,7 +398,6 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
     if (rgb.size() == 3) {
       CRGB color = CRGB(rgb[0], rgb[1], rgb[2]);
       setBaseColor(color);
-      stateChanged = true;
     }
   }
   
@@ -307,67 +405,67 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
   if (doc.containsKey("brightness")) {
     int brightness = doc["brightness"];
     setMovingIntensity(brightness / 255.0);
-    stateChanged = true;
   }
   
   // Process background mode
   if (doc.containsKey("background_mode")) {
     String mode = doc["background_mode"].as<String>();
     setBackgroundModeActive(mode == "ON");
-    stateChanged = true;
   }
   
   // Process moving_length
   if (doc.containsKey("moving_length")) {
     int length = doc["moving_length"];
     setMovingLength(length);
-    stateChanged = true;
   }
   
   // Process center_shift
   if (doc.containsKey("center_shift")) {
     int shift = doc["center_shift"];
     setCenterShift(shift);
-    stateChanged = true;
   }
   
   // Process additional_leds
   if (doc.containsKey("additional_leds")) {
     int leds = doc["additional_leds"];
     setAdditionalLEDs(leds);
-    stateChanged = true;
   }
   
   // Process led_off_delay
   if (doc.containsKey("led_off_delay")) {
     int delay = doc["led_off_delay"];
     setLedOffDelay(delay);
-    stateChanged = true;
   }
   
   // Process update_interval
   if (doc.containsKey("update_interval")) {
     int interval = doc["update_interval"];
     setUpdateInterval(interval);
-    stateChanged = true;
+  }
+  
+  // Process num_leds (applied after a restart)
+  if (doc.containsKey("num_leds")) {
+    int count = doc["num_leds"];
+    setNumLeds(count);
+  }
+
+  // Process speed_multiplier
+  if (doc.containsKey("speed_multiplier")) {
+    float multiplier = doc["speed_multiplier"];
+    setSpeedMultiplier(multiplier);
   }
   
   // Process moving_intensity
   if (doc.containsKey("moving_intensity")) {
     float intensity = doc["moving_intensity"];
     setMovingIntensity(intensity);
-    stateChanged = true;
   }
   
   // Process stationary_intensity
   if (doc.containsKey("stationary_intensity")) {
     float intensity = doc["stationary_intensity"];
     setStationaryIntensity(intensity);
-    stateChanged = true;
-  }
-  
-  // Publish updated state if anything changed
-  if (stateChanged) {
-    publishState();
   }
+
+  // The setters record what changed; handleHomeAssistant() publishes it
 }
\ No newline at end of file
@@ -7,12 +7,28 @@
 // Initialize HomeAssistant integration
 void initHomeAssistant();
 
-// Handle HomeAssistant communication
-void handleHomeAssistant();
+// Handle HomeAssistant communication; returns how many ms may pass before it
+// needs to run again (changed state waiting out the publish window)
+unsigned long handleHomeAssistant();
 
-// Set MQTT server
+// MQTT connection and publish counters
+struct MqttStats {
+  uint32_t connects;          // successful (re)connects
+  uint32_t connectFailures;
+  uint32_t publishFailures;
+  bool connected;
+};
+
+MqttStats getMqttStats();
+
+// Set MQTT server and connect to it; only from the task running
+// handleHomeAssistant()
 void setMqttServer(String server);
 
+// Reconnect with the saved MQTT settings on the next handleHomeAssistant();
+// safe from any task
+void requestMqttReconnect();
+
 // Helper function to create number entities for HomeAssistant
 void createNumberEntity(JsonDocument& deviceDoc, String name, String field, float min, float max, float step);
 
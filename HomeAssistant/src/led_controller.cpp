@@ -2,234 +2,550 @@
 #include "config.h"
 #include "storage.h"
 #include "sensor_manager.h"
+#include "compositor.h"
+#include "log.h"
 
-// Define LED array
-CRGB leds[NUM_LEDS];
+// Frame memory. Everything sized by the LED count is carved once at boot
+// from one static arena big enough for MAX_NUM_LEDS, so the strip length can
+// be a setting without any allocation after startup.
+// Frame buffer plus the beam and tail shapes, each padded to 4 bytes, and an
+// output buffer for segments wired in reverse
+#if LED_REVERSED_SEGMENTS
+#define LED_MIRROR_SIZE (MAX_NUM_LEDS * sizeof(CRGB) + 4)
+#else
+#define LED_MIRROR_SIZE 0
+#endif
+#define LED_ARENA_SIZE (MAX_NUM_LEDS * sizeof(CRGB) + 2 * (MAX_NUM_LEDS + 2) + 3 * 4 + LED_MIRROR_SIZE)
+
+#if LED_SEGMENTS < 1 || LED_SEGMENTS > 4
+#error "LED_SEGMENTS must be between 1 and 4"
+#endif
+
+static uint32_t ledArena[(LED_ARENA_SIZE + 3) / 4];
+static size_t ledArenaUsed = 0;
+
+CRGB *leds = NULL;
+static int ledCount = 0;
+
+// Output segments: logical LEDs [start, start + length) go out on one data
+// line. A reversed segment is sent from a mirrored copy of its range;
+// the others hand FastLED their slice of leds directly.
+struct LedSegment {
+  int start;
+  int length;
+  bool reversed;
+  CRGB *output;
+};
+
+static LedSegment segments[LED_SEGMENTS];
+static bool segmentsStale = false;
+
+static unsigned long lastShowTime = 0;
+
+// Frame counters and timing. Written by the LED task; the mux keeps a
+// getFrameStats() from another task consistent.
+static volatile uint32_t framesRendered = 0;
+static volatile uint32_t framesShown = 0;
+static uint32_t missedDeadlines = 0;
+static uint32_t frameTimeMin = UINT32_MAX;
+static uint32_t frameTimeMax = 0;
+static uint64_t frameTimeTotal = 0;
+static uint32_t frameTimeCount = 0;
+static uint32_t framePeriod = 0;
+static portMUX_TYPE frameStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static Histogram renderTimeHistogram;
+static Histogram showTimeHistogram;
+
+// How ledTask schedules the next frame, decided by what the last frame showed
+enum FrameRate {
+  FRAME_RATE_ACTIVE,   // beam on: fixed cadence at the update interval
+  FRAME_RATE_IDLE,     // light on, beam off: LED_IDLE_INTERVAL, woken by motion
+  FRAME_RATE_OFF       // light off: keep-alive only
+};
+static FrameRate frameRate = FRAME_RATE_IDLE;
+static uint32_t frameParamsGeneration = 0;
+static int frameUpdateInterval = DEFAULT_UPDATE_INTERVAL;   // from the same snapshot
+
+// Motion tracking state carried between frames
+static int lastMovementDirection = 0;
+static unsigned long lastMovementTime = 0;
+
+// A run of per-pixel scale values placed relative to the beam center, drawn
+// in the beam color. scale[1..length] holds the run with a zero entry on each
+// side so the sub-pixel blend needs no bounds checks; origin is the offset of
+// the first pixel from the center.
+struct BeamShape {
+  uint8_t *scale;
+  int length;
+  int origin;
+  int32_t centerQ8;
+};
+
+static BeamShape beamShape;
+static BeamShape tailShape;
+
+// Beam and tail shapes are rebuilt only when the render parameters are
+// republished or the direction changes, so drawing a frame is a plain scaled
+// copy without float math (the C3 has no FPU).
+static uint32_t beamProfileParams = 0;
+static int beamProfileDirection = 0;
+static bool beamProfileValid = false;
+
+// Beam color premultiplied by the moving intensity, and the glow color
+static CRGB beamColor;
+static CRGB backgroundColor;
+
+static void renderBackgroundLayer(const Layer &layer, CRGB *out, int start, int count);
+static void renderShapeLayer(const Layer &layer, CRGB *out, int start, int count);
+
+// Frame layers, bottom to top. The beam covers the glow like it always has;
+// the tail adds onto whatever is below it, which also makes the sub-pixel
+// blend continuous across the beam/tail boundary.
+static Layer backgroundLayer = { "background", BLEND_REPLACE, renderBackgroundLayer, NULL, false, { 0, 0 }, false, false, { 0, 0 } };
+static Layer beamLayer = { "beam", BLEND_REPLACE, renderShapeLayer, &beamShape, false, { 0, 0 }, false, false, { 0, 0 } };
+static Layer tailLayer = { "tail", BLEND_ADD, renderShapeLayer, &tailShape, false, { 0, 0 }, false, false, { 0, 0 } };
+
+// Take the next 4-byte aligned block from the arena
+static void *arenaTake(size_t bytes) {
+  void *block = (uint8_t *)ledArena + ledArenaUsed;
+  ledArenaUsed += (bytes + 3) & ~(size_t)3;
+  return block;
+}
+
+// FastLED needs the data pin as a template argument
+static void addSegmentController(int index, CRGB *data, int length) {
+  switch (index) {
+#if LED_SEGMENTS > 1
+    case 1: FastLED.addLeds<CHIPSET, LED_PIN_2, COLOR_ORDER>(data, length); break;
+#endif
+#if LED_SEGMENTS > 2
+    case 2: FastLED.addLeds<CHIPSET, LED_PIN_3, COLOR_ORDER>(data, length); break;
+#endif
+#if LED_SEGMENTS > 3
+    case 3: FastLED.addLeds<CHIPSET, LED_PIN_4, COLOR_ORDER>(data, length); break;
+#endif
+    default: FastLED.addLeds<CHIPSET, LED_PIN, COLOR_ORDER>(data, length); break;
+  }
+}
+
+static void initSegments() {
+  CRGB *mirror = NULL;
+  if (LED_REVERSED_SEGMENTS) {
+    mirror = (CRGB *)arenaTake(ledCount * sizeof(CRGB));
+  }
+
+  int start = 0;
+  for (int i = 0; i < LED_SEGMENTS; i++) {
+    LedSegment &segment = segments[i];
+    segment.start = start;
+    segment.length = ledCount / LED_SEGMENTS + (i < ledCount % LED_SEGMENTS ? 1 : 0);
+    segment.reversed = (LED_REVERSED_SEGMENTS >> i) & 1;
+    segment.output = segment.reversed ? mirror + start : leds + start;
+    start += segment.length;
+
+    if (segment.length > 0) {
+      addSegmentController(i, segment.output, segment.length);
+    }
+  }
+  segmentsStale = false;
+}
+
+// Bring the mirrored output of reversed segments up to date with leds
+static void syncSegments() {
+  for (int i = 0; i < LED_SEGMENTS; i++) {
+    const LedSegment &segment = segments[i];
+    if (!segment.reversed) continue;
+    const CRGB *src = leds + segment.start;
+    for (int j = 0; j < segment.length; j++) {
+      segment.output[j] = src[segment.length - 1 - j];
+    }
+  }
+  segmentsStale = false;
+}
 
 void initLEDController() {
-  FastLED.addLeds<CHIPSET, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS);
+  ledCount = constrain(getNumLeds(), 1, MAX_NUM_LEDS);
+  ledArenaUsed = 0;
+  leds = (CRGB *)arenaTake(ledCount * sizeof(CRGB));
+  beamShape.scale = (uint8_t *)arenaTake(ledCount + 2);
+  tailShape.scale = (uint8_t *)arenaTake(ledCount + 2);
+  beamShape.length = 0;
+  tailShape.length = 0;
+  beamProfileValid = false;
+
+  initSegments();
+  LOG_INFO("LED buffers: %u of %u bytes for %d LEDs on %d segment(s)",
+           (unsigned)ledArenaUsed, (unsigned)sizeof(ledArena), ledCount, LED_SEGMENTS);
+
   FastLED.clear();
   FastLED.show();
+
+  initCompositor(leds, ledCount);
+  addLayer(backgroundLayer);
+  addLayer(beamLayer);
+  addLayer(tailLayer);
+
+  lastMovementDirection = 0;
+  lastMovementTime = millis();
+  lastShowTime = millis();
 }
 
-void ledTask(void * parameter) {
-  static unsigned int lastSensor = getSensorDistance();
-  static int lastMovementDirection = 0;
-  static unsigned long lastMovementTime = millis();
+int getLedCount() {
+  return ledCount;
+}
 
-  for (;;) {
-    unsigned long currentMillis = millis();
-    unsigned int currentDistance = getSensorDistance();
-    int diff = (int)currentDistance - (int)lastSensor;
-    int absDiff = abs(diff);
-
-    Serial.print("Distance: ");
-    Serial.print(currentDistance);
-    Serial.print(" | lastMovementTime: ");
-    Serial.println(lastMovementTime);
-
-    if (absDiff >= NOISE_THRESHOLD) {
-      lastMovementTime = currentMillis;
-      lastMovementDirection = (diff > 0) ? 1 : -1;
+size_t getLedMemoryUsed() {
+  return ledArenaUsed;
+}
+
+size_t getLedMemoryReserved() {
+  return sizeof(ledArena);
+}
+
+FrameStats getFrameStats() {
+  FrameStats stats;
+  portENTER_CRITICAL(&frameStatsMux);
+  stats.framesRendered = framesRendered;
+  stats.framesShown = framesShown;
+  stats.missedDeadlines = missedDeadlines;
+  stats.minFrameTime = frameTimeCount > 0 ? frameTimeMin : 0;
+  stats.avgFrameTime = frameTimeCount > 0 ? (uint32_t)(frameTimeTotal / frameTimeCount) : 0;
+  stats.maxFrameTime = frameTimeMax;
+  stats.framePeriod = framePeriod;
+  portEXIT_CRITICAL(&frameStatsMux);
+  return stats;
+}
+
+const Histogram &getRenderTimeHistogram() {
+  return renderTimeHistogram;
+}
+
+const Histogram &getShowTimeHistogram() {
+  return showTimeHistogram;
+}
+
+void resetFrameStats() {
+  portENTER_CRITICAL(&frameStatsMux);
+  frameTimeMin = UINT32_MAX;
+  frameTimeMax = 0;
+  frameTimeTotal = 0;
+  frameTimeCount = 0;
+  portEXIT_CRITICAL(&frameStatsMux);
+}
+
+// Scale value for step / (fadeWidth - 1), rounded to the nearest 1/255
+static uint8_t fadeScale(int step, int fadeWidth) {
+  return (uint8_t)((step * 255 + (fadeWidth - 1) / 2) / (fadeWidth - 1));
+}
+
+static void updateBeamProfile(const RenderParams &params, int direction) {
+  if (beamProfileValid &&
+      beamProfileParams == params.generation &&
+      beamProfileDirection == direction) {
+    return;
+  }
+
+  beamProfileParams = params.generation;
+  beamProfileDirection = direction;
+  beamProfileValid = true;
+  markLayerChanged(beamLayer);
+  markLayerChanged(tailLayer);
+
+  int movingLength = params.movingLength;
+  int additionalLEDs = params.additionalLEDs;
+  beamColor = CRGB(
+    (uint8_t)(params.baseColor.r * params.movingIntensity),
+    (uint8_t)(params.baseColor.g * params.movingIntensity),
+    (uint8_t)(params.baseColor.b * params.movingIntensity)
+  );
+
+  // Main beam covers [-halfLength, halfLength) around the center (a single
+  // pixel for lengths up to 1)
+  int halfLength = (movingLength > 1) ? movingLength / 2 : 0;
+  int mainLength = (movingLength > 1) ? min(2 * halfLength, ledCount) : 1;
+
+  beamShape.origin = -halfLength;
+  beamShape.length = mainLength;
+  memset(beamShape.scale, 0, mainLength + 2);
+
+  // Fade both edges, or only the edge opposite the tail
+  int fadeWidthMain = min(halfLength, 5);
+  bool fadeLeft = (additionalLEDs == 0 || direction >= 0);
+  bool fadeRight = (additionalLEDs == 0 || direction <= 0);
+
+  for (int rIndex = 0; rIndex < mainLength; rIndex++) {
+    uint8_t scale = 255;
+    if (fadeWidthMain > 1) {
+      if (fadeLeft && rIndex < fadeWidthMain) {
+        scale = fadeScale(rIndex, fadeWidthMain);
+      } else if (fadeRight && rIndex >= movingLength - fadeWidthMain) {
+        scale = fadeScale(movingLength - 1 - rIndex, fadeWidthMain);
+      }
     }
-    
-    lastSensor = currentDistance;
+    beamShape.scale[1 + rIndex] = scale;
+  }
 
-    // Determine if we should draw the moving light beam based on the LED off delay
-    bool drawMovingPart = (currentMillis - lastMovementTime <= getLedOffDelay() * 1000);
+  // Directional tail: starts at the first pixel past the main beam in the
+  // direction of movement and fades out towards its far end
+  int tailLength = (direction != 0 && additionalLEDs > 0) ? min(additionalLEDs, ledCount) : 0;
+  tailShape.origin = (direction > 0) ? -halfLength + mainLength : -halfLength - tailLength;
+  tailShape.length = tailLength;
+  memset(tailShape.scale, 0, tailLength + 2);
 
-    // If light is off, clear the strip
-    if (!isLightOn()) {
-      fill_solid(leds, NUM_LEDS, CRGB::Black);
+  int fadeWidthAdditional = min(additionalLEDs, 5);
+  for (int i = 0; i < tailLength; i++) {
+    uint8_t scale = 255;
+    if (additionalLEDs > 1 && i >= additionalLEDs - fadeWidthAdditional) {
+      scale = fadeScale(additionalLEDs - 1 - i, fadeWidthAdditional);
     }
-    else {
-      // If background mode is active, display the background glow regardless of motion
-      if (isBackgroundModeActive()) {
-        CRGB baseColor = getBaseColor();
-        float stationaryIntensity = getStationaryIntensity();
-        
-        fill_solid(leds, NUM_LEDS, CRGB(
-          (uint8_t)(baseColor.r * stationaryIntensity),
-          (uint8_t)(baseColor.g * stationaryIntensity),
-          (uint8_t)(baseColor.b * stationaryIntensity)
-        ));
-        
-        // Overlay the moving light beam if motion is detected
-        if (drawMovingPart) {
-          float movingIntensity = getMovingIntensity();
-          int movingLength = getMovingLength();
-          int centerShift = getCenterShift();
-          int additionalLEDs = getAdditionalLEDs();
-          
-          float prop = constrain((float)(currentDistance - MIN_DISTANCE) / (MAX_DISTANCE - MIN_DISTANCE), 0.0, 1.0);
-          int ledPosition = (diff < 0) ? ceil(prop * (NUM_LEDS - movingLength)) : round(prop * (NUM_LEDS - movingLength));
-          int centerLED = ledPosition + centerShift;
-          centerLED = constrain(centerLED, 0, NUM_LEDS - 1);
-          int halfLength = movingLength / 2;
-          
-          if (movingLength <= 1) {
-            leds[centerLED] = CRGB(
-              (uint8_t)(baseColor.r * movingIntensity),
-              (uint8_t)(baseColor.g * movingIntensity),
-              (uint8_t)(baseColor.b * movingIntensity)
-            );
-          } else {
-            int fadeWidthMain = min(halfLength, 5);
-            
-            for (int offset = -halfLength; offset < halfLength; offset++) {
-              int idx = (centerLED + offset + NUM_LEDS) % NUM_LEDS;
-              int rIndex = offset + halfLength;
-              float factor = 1.0;
-              
-              if (additionalLEDs == 0) {
-                if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
-                  factor = (float)rIndex / (fadeWidthMain - 1);
-                } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
-                  factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
-                }
-              } else {
-                if (lastMovementDirection > 0) { // Additional beam on the right: fade only on the left edge
-                  if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
-                    factor = (float)rIndex / (fadeWidthMain - 1);
-                  }
-                } else if (lastMovementDirection < 0) { // Additional beam on the left: fade only on the right edge
-                  if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
-                    factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
-                  }
-                } else {
-                  if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
-                    factor = (float)rIndex / (fadeWidthMain - 1);
-                  } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
-                    factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
-                  }
-                }
-              }
-              
-              leds[idx] = CRGB(
-                (uint8_t)(baseColor.r * movingIntensity * factor),
-                (uint8_t)(baseColor.g * movingIntensity * factor),
-                (uint8_t)(baseColor.b * movingIntensity * factor)
-              );
-            }
-          }
-          
-          if (lastMovementDirection != 0 && additionalLEDs > 0) {
-            int fadeWidthAdditional = min(additionalLEDs, 5);
-            
-            for (int i = 0; i < additionalLEDs; i++) {
-              int idx = (lastMovementDirection > 0) ? centerLED + halfLength + i : centerLED - halfLength - i;
-              
-              if (idx < 0 || idx >= NUM_LEDS) break;
-              
-              float factor = 1.0;
-              if (additionalLEDs > 1) {
-                if (i >= additionalLEDs - fadeWidthAdditional) {
-                  factor = (float)(additionalLEDs - 1 - i) / (fadeWidthAdditional - 1);
-                }
-              }
-              
-              leds[idx] = CRGB(
-                (uint8_t)(baseColor.r * movingIntensity * factor),
-                (uint8_t)(baseColor.g * movingIntensity * factor),
-                (uint8_t)(baseColor.b * movingIntensity * factor)
-              );
-            }
-          }
-        }
-      }
-      else { 
-        // If background mode is off, display the moving light beam on a black background
-        if (drawMovingPart) {
-          fill_solid(leds, NUM_LEDS, CRGB::Black);
-          
-          CRGB baseColor = getBaseColor();
-          float movingIntensity = getMovingIntensity();
-          int movingLength = getMovingLength();
-          int centerShift = getCenterShift();
-          int additionalLEDs = getAdditionalLEDs();
-          
-          float prop = constrain((float)(currentDistance - MIN_DISTANCE) / (MAX_DISTANCE - MIN_DISTANCE), 0.0, 1.0);
-          int ledPosition = (diff < 0) ? ceil(prop * (NUM_LEDS - movingLength)) : round(prop * (NUM_LEDS - movingLength));
-          int centerLED = ledPosition + centerShift;
-          centerLED = constrain(centerLED, 0, NUM_LEDS - 1);
-          int halfLength = movingLength / 2;
-          
-          if (movingLength <= 1) {
-            leds[centerLED] = CRGB(
-              (uint8_t)(baseColor.r * movingIntensity),
-              (uint8_t)(baseColor.g * movingIntensity),
-              (uint8_t)(baseColor.b * movingIntensity)
-            );
-          } else {
-            int fadeWidthMain = min(halfLength, 5);
-            
-            for (int offset = -halfLength; offset < halfLength; offset++) {
-              int idx = (centerLED + offset + NUM_LEDS) % NUM_LEDS;
-              int rIndex = offset + halfLength;
-              float factor = 1.0;
-              
-              if (additionalLEDs == 0) {
-                if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
-                  factor = (float)rIndex / (fadeWidthMain - 1);
-                } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
-                  factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
-                }
-              } else {
-                if (lastMovementDirection > 0) {
-                  if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
-                    factor = (float)rIndex / (fadeWidthMain - 1);
-                  }
-                } else if (lastMovementDirection < 0) {
-                  if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
-                    factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
-                  }
-                } else {
-                  if (fadeWidthMain > 1 && rIndex < fadeWidthMain) {
-                    factor = (float)rIndex / (fadeWidthMain - 1);
-                  } else if (fadeWidthMain > 1 && rIndex >= movingLength - fadeWidthMain) {
-                    factor = (float)(movingLength - 1 - rIndex) / (fadeWidthMain - 1);
-                  }
-                }
-              }
-              
-              leds[idx] = CRGB(
-                (uint8_t)(baseColor.r * movingIntensity * factor),
-                (uint8_t)(baseColor.g * movingIntensity * factor),
-                (uint8_t)(baseColor.b * movingIntensity * factor)
-              );
-            }
-          }
-          
-          if (lastMovementDirection != 0 && additionalLEDs > 0) {
-            int fadeWidthAdditional = min(additionalLEDs, 5);
-            
-            for (int i = 0; i < additionalLEDs; i++) {
-              int idx = (lastMovementDirection > 0) ? centerLED + halfLength + i : centerLED - halfLength - i;
-              
-              if (idx < 0 || idx >= NUM_LEDS) break;
-              
-              float factor = 1.0;
-              if (additionalLEDs > 1) {
-                if (i >= additionalLEDs - fadeWidthAdditional) {
-                  factor = (float)(additionalLEDs - 1 - i) / (fadeWidthAdditional - 1);
-                }
-              }
-              
-              leds[idx] = CRGB(
-                (uint8_t)(baseColor.r * movingIntensity * factor),
-                (uint8_t)(baseColor.g * movingIntensity * factor),
-                (uint8_t)(baseColor.b * movingIntensity * factor)
-              );
-            }
-          }
-        }
-        else {
-          fill_solid(leds, NUM_LEDS, CRGB::Black);
-        }
-      }
+    tailShape.scale[1 + ((direction > 0) ? i : tailLength - 1 - i)] = scale;
+  }
+}
+
+// Draw strip pixels [start, start + count) of a shape. On a whole-pixel
+// center the run is a straight scaled copy; on a fractional one neighbouring
+// entries are blended by the fraction, which shifts the shape right by that
+// fraction. The variant is picked once per call in renderShapeLayer(), so
+// neither inner loop branches.
+template <bool SubPixel>
+static void drawShape(const BeamShape &shape, CRGB *out, int start, int count) {
+  int32_t centerQ8 = shape.centerQ8;
+  const uint8_t *profile = shape.scale + 1 + (start - ((centerQ8 >> 8) + shape.origin));
+
+  if (SubPixel) {
+    uint16_t frac = centerQ8 & 0xFF;
+    uint16_t inv = 256 - frac;
+    for (int i = 0; i < count; i++) {
+      out[i] = beamColor;
+      out[i].nscale8((profile[i] * inv + profile[i - 1] * frac) >> 8);
+    }
+  } else {
+    for (int i = 0; i < count; i++) {
+      out[i] = beamColor;
+      out[i].nscale8(profile[i]);
     }
+  }
+}
+
+static void renderShapeLayer(const Layer &layer, CRGB *out, int start, int count) {
+  const BeamShape &shape = *(const BeamShape *)layer.context;
+  if (shape.centerQ8 & 0xFF) {
+    drawShape<true>(shape, out, start, count);
+  } else {
+    drawShape<false>(shape, out, start, count);
+  }
+}
+
+static void renderBackgroundLayer(const Layer &layer, CRGB *out, int start, int count) {
+  fill_solid(out, count, backgroundColor);
+}
+
+// Position a shape layer for this frame. The beam center is kept in 8.8
+// fixed point; a fractional center spills one extra pixel.
+static void placeShape(Layer &layer, BeamShape &shape, bool visible, int32_t centerQ8) {
+  visible = visible && shape.length > 0;
+  if (visible && centerQ8 != shape.centerQ8) {
+    shape.centerQ8 = centerQ8;
+    markLayerChanged(layer);
+  }
+  int32_t center = shape.centerQ8;
+  placeLayer(layer, visible, { (center >> 8) + shape.origin, shape.length + ((center & 0xFF) ? 1 : 0) });
+}
+
+// The filtered track shows a moving target
+static bool trackMoving(const SensorTrack &track) {
+  return track.confidence >= TRACK_MIN_CONFIDENCE && fabsf(track.velocity) >= MOTION_VELOCITY_THRESHOLD;
+}
+
+// Target position extrapolated from the last sample to the moment this frame
+// is shown. The lead is the sample age plus a fixed sensor/output latency,
+// scaled by the speed multiplier (0 disables prediction). A stationary or
+// uncertain target is not extrapolated, so velocity noise never moves the beam.
+static float predictedPosition(const SensorTrack &track, unsigned long now, float speedMultiplier) {
+  if (speedMultiplier <= 0.0f || !trackMoving(track)) {
+    return track.position;
+  }
+
+  float leadMs = ((now - track.timestamp) + PREDICTION_LATENCY_OFFSET) * speedMultiplier;
+  leadMs = min(leadMs, (float)PREDICTION_MAX_LEAD);
+  return track.position + track.velocity * (leadMs / 1000.0f);
+}
+
+bool renderLEDFrame() {
+  // One snapshot per frame, so a settings change from another task never
+  // lands halfway through a frame
+  RenderParams params;
+  getRenderParams(params);
+
+  unsigned long currentMillis = millis();
+  unsigned int currentDistance = getSensorDistance();
+  SensorTrack track = getSensorTrack();
+
+  LOG_EVERY(LOG_LEVEL_DEBUG, 1000, "Distance: %u | lastMovementTime: %lu", currentDistance, lastMovementTime);
+
+  // Movement and its direction come from the filtered velocity, so sensor
+  // jitter neither wakes the strip nor flips the direction
+  if (trackMoving(track)) {
+    lastMovementTime = currentMillis;
+    lastMovementDirection = (track.velocity > 0) ? 1 : -1;
+  }
+
+  // Determine if we should draw the moving light beam based on the LED off delay
+  bool drawMovingPart = (currentMillis - lastMovementTime <= params.ledOffDelay * 1000);
+
+  // Background glow when background mode is active, regardless of motion
+  CRGB background = CRGB::Black;
+  if (params.lightOn && params.backgroundMode) {
+    background = CRGB(
+      (uint8_t)(params.baseColor.r * params.stationaryIntensity),
+      (uint8_t)(params.baseColor.g * params.stationaryIntensity),
+      (uint8_t)(params.baseColor.b * params.stationaryIntensity)
+    );
+  }
+  if (background != backgroundColor) {
+    backgroundColor = background;
+    markLayerChanged(backgroundLayer);
+  }
+  placeLayer(backgroundLayer, background != CRGB(CRGB::Black), { 0, ledCount });
+
+  // Moving light beam and its tail while motion is recent
+  bool beamVisible = params.lightOn && drawMovingPart;
+  int32_t centerQ8 = 0;
+  if (beamVisible) {
+    int movingLength = params.movingLength;
+    int centerShift = params.centerShift;
+
+    updateBeamProfile(params, lastMovementDirection);
+
+    // Beam center in 8.8 fixed point, so slow movement shifts the beam by
+    // fractions of an LED instead of whole-LED jumps
+    float position = predictedPosition(track, currentMillis, params.speedMultiplier);
+    float prop = constrain((position - MIN_DISTANCE) / (MAX_DISTANCE - MIN_DISTANCE), 0.0f, 1.0f);
+    centerQ8 = (int32_t)(prop * (ledCount - movingLength) * 256.0f + 0.5f) + centerShift * 256;
+    centerQ8 = constrain(centerQ8, 0, (ledCount - 1) * 256);
+  }
+  placeShape(beamLayer, beamShape, beamVisible, centerQ8);
+  placeShape(tailLayer, tailShape, beamVisible, centerQ8);
+
+  // The next frame is scheduled by what this one shows
+  frameRate = beamVisible ? FRAME_RATE_ACTIVE : (params.lightOn ? FRAME_RATE_IDLE : FRAME_RATE_OFF);
+  frameParamsGeneration = params.generation;
+  frameUpdateInterval = params.updateInterval;
+  framesRendered++;
 
+  // Only the pixels under layers that moved or changed are recomposed
+  return composeFrame();
+}
+
+void updateLEDFrame() {
+  unsigned long renderStart = micros();
+  bool changed = renderLEDFrame();
+  observeHistogram(renderTimeHistogram, micros() - renderStart);
+
+  unsigned long now = millis();
+  if (changed) {
+    segmentsStale = true;
+  }
+
+  // Push the frame only when it changed, plus a periodic keep-alive refresh
+  // so a glitched strip recovers even while the picture is static
+  if (changed || (LED_KEEPALIVE_INTERVAL > 0 && now - lastShowTime >= LED_KEEPALIVE_INTERVAL)) {
+    if (segmentsStale) {
+      syncSegments();
+    }
+    // FastLED starts every controller on its own RMT channel before waiting,
+    // so the segments are sent in parallel
+    unsigned long showStart = micros();
     FastLED.show();
-    vTaskDelay(pdMS_TO_TICKS(getUpdateInterval()));
+    observeHistogram(showTimeHistogram, micros() - showStart);
+    lastShowTime = now;
+    framesShown++;
+  }
+}
+
+static void recordFrameTime(uint32_t elapsed) {
+  portENTER_CRITICAL(&frameStatsMux);
+  frameTimeMin = min(frameTimeMin, elapsed);
+  frameTimeMax = max(frameTimeMax, elapsed);
+  frameTimeTotal += elapsed;
+  frameTimeCount++;
+  portEXIT_CRITICAL(&frameStatsMux);
+}
+
+static void setFramePeriod(uint32_t period) {
+  portENTER_CRITICAL(&frameStatsMux);
+  framePeriod = period;
+  portEXIT_CRITICAL(&frameStatsMux);
+}
+
+// Sleep until the next frame is due; lastWake is when the current frame
+// started. While the beam is on, frames follow a fixed cadence like
+// vTaskDelayUntil(), at the update interval of the snapshot the last frame
+// was rendered from, so render time does not stretch the period. A frame that
+// overruns counts the deadlines it missed and restarts the cadence instead of
+// bursting to catch up. Otherwise the task waits out the idle interval or the
+// keep-alive, waking early when a setting changes or, with the light on, when
+// a new sample shows the target moving.
+static void waitForNextFrame(TickType_t &lastWake) {
+  if (frameRate == FRAME_RATE_ACTIVE) {
+    TickType_t period = pdMS_TO_TICKS(max(frameUpdateInterval, LED_MIN_FRAME_INTERVAL));
+    setFramePeriod(period * portTICK_PERIOD_MS);
+
+    TickType_t elapsed = xTaskGetTickCount() - lastWake;
+    if (elapsed > period) {
+      portENTER_CRITICAL(&frameStatsMux);
+      missedDeadlines += elapsed / period;
+      portEXIT_CRITICAL(&frameStatsMux);
+      lastWake = xTaskGetTickCount();
+    } else {
+      vTaskDelayUntil(&lastWake, period);
+    }
+
+    // The frame about to render picks up any sample that arrived meanwhile
+    xTaskNotifyWait(0, 0xFFFFFFFF, NULL, 0);
+    return;
   }
-}
\ No newline at end of file
+
+  // Samples only matter while the light is on and the beam can come on
+  bool lightOn = (frameRate == FRAME_RATE_IDLE);
+  setSensorListener(lightOn ? xTaskGetCurrentTaskHandle() : NULL);
+
+  TickType_t period = portMAX_DELAY;
+  if (lightOn) {
+    period = pdMS_TO_TICKS(LED_IDLE_INTERVAL);
+  } else if (LED_KEEPALIVE_INTERVAL > 0) {
+    period = pdMS_TO_TICKS(LED_KEEPALIVE_INTERVAL);
+  }
+  setFramePeriod(period == portMAX_DELAY ? 0 : period * portTICK_PERIOD_MS);
+
+  for (;;) {
+    TickType_t timeout = portMAX_DELAY;
+    if (period != portMAX_DELAY) {
+      TickType_t elapsed = xTaskGetTickCount() - lastWake;
+      if (elapsed >= period) break;
+      timeout = period - elapsed;
+    }
+    if (xTaskNotifyWait(0, 0xFFFFFFFF, NULL, timeout) != pdTRUE) break;
+
+    RenderParams params;
+    getRenderParams(params);
+    if (params.generation != frameParamsGeneration) break;
+    if (lightOn && trackMoving(getSensorTrack())) break;
+  }
+  lastWake = xTaskGetTickCount();
+}
+
+void ledTask(void * parameter) {
+  // Woken early by setting changes, and by new samples while the light is on
+  setRenderParamsListener(xTaskGetCurrentTaskHandle());
+  setSensorListener(xTaskGetCurrentTaskHandle());
+
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    unsigned long frameStart = micros();
+    updateLEDFrame();
+    recordFrameTime(micros() - frameStart);
+
+    waitForNextFrame(lastWake);
+  }
+}
@@ -3,10 +3,47 @@
 
 #include <Arduino.h>
 #include <FastLED.h>
+#include "metrics.h"
 
 // Initialize LED controller
 void initLEDController();
 
+// Render one frame into the LED buffer (does not call FastLED.show()).
+// Returns false when the frame is identical to the previous one.
+bool renderLEDFrame();
+
+// Render one frame and push it to the strip if it changed or the
+// keep-alive interval has elapsed
+void updateLEDFrame();
+
+// Number of LEDs driven, fixed at boot from the stored setting
+int getLedCount();
+
+// Frame buffer memory in use for the current LED count, and reserved for
+// the largest supported strip
+size_t getLedMemoryUsed();
+size_t getLedMemoryReserved();
+
+// LED task frame counters and timing
+struct FrameStats {
+  uint32_t framesRendered;    // frames evaluated by the LED task
+  uint32_t framesShown;       // frames pushed to the strip
+  uint32_t missedDeadlines;   // fixed-cadence frames that started late
+  uint32_t minFrameTime;      // us to render and show one frame, since the last reset
+  uint32_t avgFrameTime;
+  uint32_t maxFrameTime;
+  uint32_t framePeriod;       // ms between frames right now; 0 = waiting for a change
+};
+
+FrameStats getFrameStats();
+
+// Start a new min/avg/max frame time window
+void resetFrameStats();
+
+// Time spent in renderLEDFrame() and in FastLED.show(), per frame
+const Histogram &getRenderTimeHistogram();
+const Histogram &getShowTimeHistogram();
+
 // LED task function
 void ledTask(void * parameter);
 
@@ -0,0 +1,175 @@
+#include "log.h"
+#include <atomic>
+
+#if (LOG_RING_SIZE & (LOG_RING_SIZE - 1)) != 0
+#error "LOG_RING_SIZE must be a power of two"
+#endif
+
+volatile uint8_t logLevel = LOG_LEVEL;
+
+// Bounded multi-producer ring. Each slot carries a sequence number: equal to
+// a write position when the slot is free for it, one more once the record is
+// in, and advanced by a full lap when the reader has taken it. Writers claim
+// a position with a compare-and-swap, so no task ever waits for another;
+// logTask is the only reader.
+struct LogSlot {
+  std::atomic<uint32_t> sequence;
+  LogRecord record;
+};
+
+static LogSlot ring[LOG_RING_SIZE];
+static std::atomic<uint32_t> writePosition(0);
+static uint32_t readPosition = 0;
+static std::atomic<uint32_t> dropped(0);
+
+void initLog() {
+  for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  writePosition.store(0, std::memory_order_relaxed);
+  readPosition = 0;
+}
+
+void setLogLevel(uint8_t level) {
+  logLevel = constrain(level, (uint8_t)LOG_LEVEL_ERROR, (uint8_t)LOG_LEVEL_DEBUG);
+}
+
+uint32_t getLogDropped() {
+  return dropped.load(std::memory_order_relaxed);
+}
+
+bool logRateAllow(LogSite &site, uint32_t interval, uint16_t &suppressed) {
+  uint32_t now = millis();
+  if (site.used && now - site.lastTime < interval) {
+    if (site.suppressed < UINT16_MAX) site.suppressed++;
+    return false;
+  }
+  site.used = true;
+  site.lastTime = now;
+  suppressed = site.suppressed;
+  site.suppressed = 0;
+  return true;
+}
+
+void logSubmit(LogRecord &record) {
+  uint32_t position = writePosition.load(std::memory_order_relaxed);
+  LogSlot *slot;
+  for (;;) {
+    slot = &ring[position & (LOG_RING_SIZE - 1)];
+    int32_t lag = (int32_t)(slot->sequence.load(std::memory_order_acquire) - position);
+    if (lag == 0) {
+      if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (lag < 0) {
+      // Full: the reader has not freed this slot yet
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = writePosition.load(std::memory_order_relaxed);
+    }
+  }
+
+  memcpy(&slot->record, &record, sizeof(LogRecord));
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+// Format one record into line. Conversions are taken from the format in
+// order: %s reads the next copied string, floating point conversions read a
+// float, everything else a 32-bit integer. Length modifiers are ignored
+// because every numeric argument was stored as 32 bits.
+static size_t formatRecord(const LogRecord &record, char *line, size_t size) {
+  static const char levelNames[] = "?EWID";
+  int n = snprintf(line, size, "[%lu.%03lu] %c: ",
+                   (unsigned long)(record.time / 1000), (unsigned long)(record.time % 1000),
+                   levelNames[record.level <= LOG_LEVEL_DEBUG ? record.level : 0]);
+  size_t used = n > 0 ? min((size_t)n, size - 1) : 0;
+
+  uint8_t arg = 0;
+  const char *text = record.text;
+  const char *textEnd = record.text + record.textUsed;
+
+  for (const char *p = record.format; *p && used < size - 1; ) {
+    if (*p != '%') {
+      line[used++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      line[used++] = '%';
+      p += 2;
+      continue;
+    }
+
+    // Copy flags, width and precision; drop length modifiers
+    char spec[16];
+    size_t specLength = 0;
+    spec[specLength++] = *p++;
+    while (*p && strchr("-+ #0123456789.*hlzjt", *p)) {
+      if (!strchr("hlzjt", *p) && specLength < sizeof(spec) - 2) spec[specLength++] = *p;
+      p++;
+    }
+    char conversion = *p;
+    if (!conversion) break;
+    p++;
+    spec[specLength++] = conversion;
+    spec[specLength] = '\0';
+
+    char *out = line + used;
+    size_t room = size - used;
+    if (conversion == 's') {
+      const char *value = "";
+      if (text < textEnd) {
+        value = text;
+        text += strlen(text) + 1;
+      }
+      n = snprintf(out, room, spec, value);
+    } else if (arg >= record.argCount) {
+      n = 0;
+    } else if (strchr("fFeEgG", conversion)) {
+      float value;
+      memcpy(&value, &record.args[arg++], sizeof(value));
+      n = snprintf(out, room, spec, (double)value);
+    } else if (strchr("di", conversion)) {
+      n = snprintf(out, room, spec, (int)record.args[arg++]);
+    } else if (conversion == 'c') {
+      n = snprintf(out, room, spec, (int)record.args[arg++]);
+    } else {
+      n = snprintf(out, room, spec, (unsigned int)record.args[arg++]);
+    }
+    if (n > 0) used += min((size_t)n, room - 1);
+  }
+
+  if (record.suppressed > 0 && used < size - 1) {
+    n = snprintf(line + used, size - used, " (+%u suppressed)", (unsigned)record.suppressed);
+    if (n > 0) used += min((size_t)n, size - used - 1);
+  }
+  line[used] = '\0';
+  return used;
+}
+
+void logFlush() {
+  char line[160];
+  for (;;) {
+    LogSlot &slot = ring[readPosition & (LOG_RING_SIZE - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1) break;
+
+    formatRecord(slot.record, line, sizeof(line));
+    slot.sequence.store(readPosition + LOG_RING_SIZE, std::memory_order_release);
+    readPosition++;
+    Serial.println(line);
+  }
+
+  static uint32_t droppedReported = 0;
+  uint32_t droppedNow = getLogDropped();
+  if (droppedNow != droppedReported) {
+    Serial.printf("[log] %lu message(s) dropped\n", (unsigned long)(droppedNow - droppedReported));
+    droppedReported = droppedNow;
+  }
+}
+
+void logTask(void * parameter) {
+  for (;;) {
+    logFlush();
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL));
+  }
+}
@@ -0,0 +1,132 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Deferred logging. A call site only checks the level, packs its arguments
+// into a fixed-size record and copies it into a ring buffer; formatting and
+// the (blocking) Serial output happen later in logTask at the lowest task
+// priority. Safe to call from any task; never blocks, drops when full.
+//
+//   LOG_INFO("Connected to %s, rc=%d", server, rc);
+//   LOG_EVERY(LOG_LEVEL_DEBUG, 1000, "Distance: %u", distance);
+//
+// The format must be a string literal: only its pointer is stored. Numeric
+// arguments are stored as 32 bits (floats as float); string arguments are
+// copied, up to LOG_TEXT_LENGTH bytes per record in total.
+
+enum LogLevel {
+  LOG_LEVEL_ERROR = 1,
+  LOG_LEVEL_WARN  = 2,
+  LOG_LEVEL_INFO  = 3,
+  LOG_LEVEL_DEBUG = 4
+};
+
+struct LogRecord {
+  uint32_t time;                  // millis()
+  const char *format;
+  uint8_t level;
+  uint8_t argCount;
+  uint8_t textUsed;
+  uint16_t suppressed;            // messages the call site's rate limit skipped before this one
+  uint32_t args[LOG_MAX_ARGS];
+  char text[LOG_TEXT_LENGTH];     // string arguments, each NUL-terminated
+};
+
+// Per-call-site rate limit state (one static instance per LOG_EVERY)
+struct LogSite {
+  uint32_t lastTime;
+  uint16_t suppressed;
+  bool used;
+};
+
+// Set up the ring; call first in setup(), before anything logs
+void initLog();
+
+// Runtime level; starts at LOG_LEVEL
+extern volatile uint8_t logLevel;
+void setLogLevel(uint8_t level);
+
+// Records dropped because the ring was full
+uint32_t getLogDropped();
+
+// Queue a packed record
+void logSubmit(LogRecord &record);
+
+// True when the call site may log now, with the number of messages it
+// skipped since the last one in suppressed; counts this one as skipped otherwise
+bool logRateAllow(LogSite &site, uint32_t interval, uint16_t &suppressed);
+
+// Drain the ring to Serial (logTask does this; also usable before the
+// scheduler starts)
+void logFlush();
+
+// Log task function
+void logTask(void * parameter);
+
+// ------------------------- Argument packing -------------------------
+
+inline void logPutWord(LogRecord &record, uint32_t value) {
+  if (record.argCount < LOG_MAX_ARGS) record.args[record.argCount++] = value;
+}
+inline void logPut(LogRecord &record, int value) { logPutWord(record, (uint32_t)value); }
+inline void logPut(LogRecord &record, unsigned int value) { logPutWord(record, (uint32_t)value); }
+inline void logPut(LogRecord &record, long value) { logPutWord(record, (uint32_t)value); }
+inline void logPut(LogRecord &record, unsigned long value) { logPutWord(record, (uint32_t)value); }
+inline void logPut(LogRecord &record, double value) {
+  float f = (float)value;
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  logPutWord(record, bits);
+}
+inline void logPut(LogRecord &record, const char *value) {
+  size_t room = LOG_TEXT_LENGTH - record.textUsed;
+  if (room == 0) return;
+  size_t length = value ? strnlen(value, room - 1) : 0;
+  memcpy(record.text + record.textUsed, value, length);
+  record.text[record.textUsed + length] = '\0';
+  record.textUsed += length + 1;
+}
+inline void logPut(LogRecord &record, const String &value) { logPut(record, value.c_str()); }
+
+inline void logPack(LogRecord &record) {}
+
+template<typename T, typename... Rest>
+inline void logPack(LogRecord &record, const T &value, const Rest &... rest) {
+  logPut(record, value);
+  logPack(record, rest...);
+}
+
+template<typename... Args>
+void logWrite(uint8_t level, uint16_t suppressed, const char *format, const Args &... args) {
+  LogRecord record;
+  record.time = millis();
+  record.format = format;
+  record.level = level;
+  record.argCount = 0;
+  record.textUsed = 0;
+  record.suppressed = suppressed;
+  logPack(record, args...);
+  logSubmit(record);
+}
+
+#define LOG_AT(level, format, ...) do { \
+    if ((level) <= logLevel) logWrite((level), 0, format, ##__VA_ARGS__); \
+  } while (0)
+
+// At most one message per interval (ms) from this call site; the next one
+// that gets through reports how many were skipped
+#define LOG_EVERY(level, interval, format, ...) do { \
+    static LogSite logSite_ = { 0, 0, false }; \
+    uint16_t logSuppressed_; \
+    if ((level) <= logLevel && logRateAllow(logSite_, (interval), logSuppressed_)) \
+      logWrite((level), logSuppressed_, format, ##__VA_ARGS__); \
+  } while (0)
+
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...)  LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...)  LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+
+#endif // LOG_H
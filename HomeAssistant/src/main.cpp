@@ -1,5 +1,5 @@
 #include <Arduino.h>
-#include <SPIFFS.h>
+#include <LittleFS.h>
 #include <ArduinoOTA.h>
 #include <time.h>
 #include <Preferences.h>
@@ -11,18 +11,21 @@
 #include "web_server.h"
 #include "storage.h"
 #include "home_assistant.h"
+#include "log.h"
+#include "metrics.h"
 
 // Task handles
 TaskHandle_t sensorTaskHandle = NULL;
 TaskHandle_t ledTaskHandle = NULL;
 TaskHandle_t serverTaskHandle = NULL;
 TaskHandle_t debugTaskHandle = NULL;
+TaskHandle_t storageTaskHandle = NULL;
+TaskHandle_t logTaskHandle = NULL;
 
 // Debug Task
 void debugTask(void * parameter) {
   for (;;) {
-    Serial.print("Sensor distance: ");
-    Serial.println(getSensorDistance());
+    LOG_DEBUG("Sensor distance: %u", getSensorDistance());
     vTaskDelay(pdMS_TO_TICKS(1000));
   }
 }
@@ -60,28 +63,30 @@ void updateTime() {
 void setupOTA() {
   ArduinoOTA.onStart([]() {
     String type = ArduinoOTA.getCommand() == U_FLASH ? "sketch" : "filesystem";
-    Serial.println("Start updating " + type);
+    LOG_INFO("Start updating %s", type);
+    // The device reboots after the update; don't lose pending settings
+    flushSettings(true);
   });
   
   ArduinoOTA.onEnd([]() {
-    Serial.println("\nEnd");
+    LOG_INFO("Update finished");
   });
   
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+    LOG_EVERY(LOG_LEVEL_INFO, 1000, "Progress: %u%%", (progress / (total / 100)));
   });
   
   ArduinoOTA.onError([](ota_error_t error) {
     if (error == OTA_AUTH_ERROR) {
-      Serial.println("Auth Failed");
+      LOG_ERROR("OTA auth failed");
     } else if (error == OTA_BEGIN_ERROR) {
-      Serial.println("Begin Failed");
+      LOG_ERROR("OTA begin failed");
     } else if (error == OTA_CONNECT_ERROR) {
-      Serial.println("Connect Failed");
+      LOG_ERROR("OTA connect failed");
     } else if (error == OTA_RECEIVE_ERROR) {
-      Serial.println("Receive Failed");
+      LOG_ERROR("OTA receive failed");
     } else if (error == OTA_END_ERROR) {
-      Serial.println("End Failed");
+      LOG_ERROR("OTA end failed");
     }
   });
   
@@ -90,11 +95,12 @@ void setupOTA() {
 
 void setup() {
   Serial.begin(115200);
-  Serial.println("LightTrack starting...");
+  initLog();
+  LOG_INFO("LightTrack starting...");
   
-  if (!SPIFFS.begin(true)) {
-    Serial.println("Failed to mount SPIFFS");
-    return;
+  // Web UI files; the light works without them
+  if (!LittleFS.begin(true)) {
+    LOG_ERROR("Failed to mount LittleFS");
   }
   
   // Initialize storage
@@ -115,7 +121,8 @@ void setup() {
   // Initialize web server
   initWebServer();
   
-  // Initialize HomeAssistant integration
+  // Initialize HomeAssistant integration; state changes wake loop()
+  setStateListener(xTaskGetCurrentTaskHandle());
   initHomeAssistant();
   
   // Setup OTA
@@ -126,13 +133,28 @@ void setup() {
   xTaskCreatePinnedToCore(ledTask, "LED Task", 4096, NULL, 1, &ledTaskHandle, 0);
   xTaskCreatePinnedToCore(webServerTask, "WebServer Task", 4096, NULL, 1, &serverTaskHandle, 1);
   xTaskCreatePinnedToCore(debugTask, "Debug Task", 2048, NULL, 1, &debugTaskHandle, 1);
-  
-  Serial.println("LightTrack started!");
+  xTaskCreatePinnedToCore(storageTask, "Storage Task", 3072, NULL, 1, &storageTaskHandle, 1);
+  // Lowest priority: Serial output only ever uses otherwise idle time
+  xTaskCreatePinnedToCore(logTask, "Log Task", 3072, NULL, tskIDLE_PRIORITY, &logTaskHandle, 1);
+
+  // Stack high-water marks on /metrics
+  registerTaskMetrics("loop", xTaskGetCurrentTaskHandle());
+  registerTaskMetrics("sensor", sensorTaskHandle);
+  registerTaskMetrics("led", ledTaskHandle);
+  registerTaskMetrics("webserver", serverTaskHandle);
+  // Started by the web server; it answers every HTTP request
+  registerTaskMetrics("async_tcp", xTaskGetHandle("async_tcp"));
+  registerTaskMetrics("debug", debugTaskHandle);
+  registerTaskMetrics("storage", storageTaskHandle);
+  registerTaskMetrics("log", logTaskHandle);
+  
+  LOG_INFO("LightTrack started!");
 }
 
 void loop() {
   ArduinoOTA.handle();
-  handleHomeAssistant();
+  unsigned long wait = min(handleHomeAssistant(), 1000UL);
   updateTime();
-  vTaskDelay(pdMS_TO_TICKS(1000));
+  // Setting and light changes wake the loop early so MQTT publishes them
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
 }
\ No newline at end of file
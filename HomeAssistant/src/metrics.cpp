@@ -0,0 +1,37 @@
+#include "metrics.h"
+
+const uint32_t histogramBounds[HISTOGRAM_BUCKETS] = {
+  50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000
+};
+
+void observeHistogram(Histogram &histogram, uint32_t micros) {
+  int bucket = 0;
+  while (bucket < HISTOGRAM_BUCKETS && micros > histogramBounds[bucket]) {
+    bucket++;
+  }
+  // One writer per histogram, so a relaxed load and store is enough and
+  // avoids a locked read-modify-write (emulated on the C3)
+  std::atomic<uint32_t> &counter = histogram.buckets[bucket];
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  histogram.sum.store(histogram.sum.load(std::memory_order_relaxed) + micros, std::memory_order_relaxed);
+}
+
+// Filled from setup() before the web server can read it
+static TaskMetrics tasks[METRICS_MAX_TASKS];
+static int taskCount = 0;
+
+void registerTaskMetrics(const char *name, TaskHandle_t handle) {
+  if (taskCount < METRICS_MAX_TASKS && handle != NULL) {
+    tasks[taskCount].name = name;
+    tasks[taskCount].handle = handle;
+    taskCount++;
+  }
+}
+
+int getTaskMetricsCount() {
+  return taskCount;
+}
+
+TaskMetrics getTaskMetrics(int index) {
+  return tasks[index];
+}
@@ -0,0 +1,38 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Counters and histograms updated on hot paths and read by the /metrics
+// handler. All updates are relaxed atomics: no locks, no allocation.
+
+typedef std::atomic<uint32_t> MetricCounter;
+
+// Latency histogram over fixed bucket bounds in microseconds, from 50 us to
+// 100 ms (a 3000 LED show takes ~90 ms). Buckets are not cumulative here;
+// the exporter sums them.
+#define HISTOGRAM_BUCKETS 11
+extern const uint32_t histogramBounds[HISTOGRAM_BUCKETS];
+
+struct Histogram {
+  std::atomic<uint32_t> buckets[HISTOGRAM_BUCKETS + 1];   // the last one counts samples above every bound
+  std::atomic<uint64_t> sum;                              // microseconds
+};
+
+// Record one sample. Each histogram must only be updated from one task.
+void observeHistogram(Histogram &histogram, uint32_t micros);
+
+// Tasks whose stack high-water mark is reported
+#define METRICS_MAX_TASKS 8
+
+struct TaskMetrics {
+  const char *name;
+  TaskHandle_t handle;
+};
+
+void registerTaskMetrics(const char *name, TaskHandle_t handle);
+int getTaskMetricsCount();
+TaskMetrics getTaskMetrics(int index);
+
+#endif // METRICS_H
@@ -4,49 +4,333 @@
 // Global sensor distance variable
 volatile unsigned int g_sensorDistance = DEFAULT_DISTANCE;
 
+// Time (millis) the current distance was received
+static volatile uint32_t g_sensorTimestamp = 0;
+
+// Sensor task and the task notified on every new distance
+static TaskHandle_t sensorTaskHandle = NULL;
+static TaskHandle_t sensorListener = NULL;
+
+// Valid in-range frames parsed so far; tells sensorTask a new sample arrived
+static uint32_t samplesAccepted = 0;
+
+// Median outlier filter over the last TRACK_MEDIAN_WINDOW raw samples
+static unsigned int medianWindow[TRACK_MEDIAN_WINDOW];
+static size_t medianCount = 0;
+static size_t medianNext = 0;
+
+// Alpha-beta tracking filter state, guarded by trackMux
+static SensorTrack track = { (float)DEFAULT_DISTANCE, 0.0f, 0, 0 };
+static portMUX_TYPE trackMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Sample history for the live stream and the history export, guarded by sampleMux
+#if (SENSOR_HISTORY_SIZE & (SENSOR_HISTORY_SIZE - 1)) != 0
+#error "SENSOR_HISTORY_SIZE must be a power of two"
+#endif
+static SensorSample sampleRing[SENSOR_HISTORY_SIZE];
+static uint32_t sampleSequence = 0;
+static portMUX_TYPE sampleMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Sensor frame: SENSOR_HEADER twice, then the payload. The distance is
+// little-endian in payload[1..2]; with SENSOR_CHECKSUM the last payload
+// byte is the 8-bit sum of the payload bytes before it.
+#define SENSOR_PAYLOAD_LENGTH (SENSOR_FRAME_LENGTH - 2)
+
+// Bytes drained from the UART but not parsed yet
+#define SENSOR_RX_BUFFER_SIZE 64
+
+static uint8_t rxBuffer[SENSOR_RX_BUFFER_SIZE];
+static size_t rxHead = 0;
+static size_t rxCount = 0;
+
+// Frame parser state machine
+enum ParserState {
+  WAIT_HEADER1,
+  WAIT_HEADER2,
+  READ_PAYLOAD
+};
+
+static ParserState parserState = WAIT_HEADER1;
+static uint8_t payload[SENSOR_PAYLOAD_LENGTH];
+static size_t payloadLength = 0;
+static bool parserSynced = false;
+
+static SensorStats sensorStats = { 0, 0, 0, 0 };
+
+// Runs in the UART event task whenever bytes arrive (FIFO threshold or RX timeout)
+static void onSensorReceive() {
+  if (sensorTaskHandle != NULL) {
+    xTaskNotifyGive(sensorTaskHandle);
+  }
+}
+
 void initSensor() {
   Serial1.begin(SENSOR_BAUD_RATE, SERIAL_8N1, 20, 21);
+  Serial1.onReceive(onSensorReceive);
 }
 
 unsigned int getSensorDistance() {
   return g_sensorDistance;
 }
 
+uint32_t getSensorTimestamp() {
+  return g_sensorTimestamp;
+}
+
+SensorTrack getSensorTrack() {
+  portENTER_CRITICAL(&trackMux);
+  SensorTrack current = track;
+  portEXIT_CRITICAL(&trackMux);
+
+  // Without in-range samples the track is only aged here: once it is older
+  // than TRACK_RESET_TIMEOUT it reports no motion, so a target that left the
+  // range, or a silent sensor, can't keep the beam on
+  if (current.confidence != 0 && millis() - current.timestamp > TRACK_RESET_TIMEOUT) {
+    current.velocity = 0.0f;
+    current.confidence = 0;
+  }
+  return current;
+}
+
+void setSensorListener(TaskHandle_t task) {
+  sensorListener = task;
+}
+
+static void recordSample(unsigned int distance, float position, uint32_t now) {
+  portENTER_CRITICAL(&sampleMux);
+  uint32_t sequence = ++sampleSequence;
+  SensorSample &sample = sampleRing[sequence & (SENSOR_HISTORY_SIZE - 1)];
+  sample.sequence = sequence;
+  sample.timestamp = now;
+  sample.distance = distance;
+  sample.position = position;
+  portEXIT_CRITICAL(&sampleMux);
+}
+
+size_t getSensorSamples(uint32_t after, SensorSample *out, size_t max) {
+  portENTER_CRITICAL(&sampleMux);
+  uint32_t newest = sampleSequence;
+  uint32_t first = after + 1;
+  if (newest >= SENSOR_HISTORY_SIZE && first < newest - SENSOR_HISTORY_SIZE + 1) {
+    first = newest - SENSOR_HISTORY_SIZE + 1;
+  }
+  size_t count = 0;
+  for (uint32_t sequence = first; sequence <= newest && count < max; sequence++) {
+    out[count++] = sampleRing[sequence & (SENSOR_HISTORY_SIZE - 1)];
+  }
+  portEXIT_CRITICAL(&sampleMux);
+  return count;
+}
+
+uint32_t getSensorSequence() {
+  portENTER_CRITICAL(&sampleMux);
+  uint32_t sequence = sampleSequence;
+  portEXIT_CRITICAL(&sampleMux);
+  return sequence;
+}
+
+SensorStats getSensorStats() {
+  return sensorStats;
+}
+
+// Move whatever the UART has received into the ring buffer without waiting
+static void drainUart() {
+  while (rxCount < SENSOR_RX_BUFFER_SIZE && Serial1.available() > 0) {
+    int c = Serial1.read();
+    if (c < 0) break;
+    rxBuffer[(rxHead + rxCount) % SENSOR_RX_BUFFER_SIZE] = (uint8_t)c;
+    rxCount++;
+  }
+}
+
+static void acceptSample(unsigned int distance) {
+  medianWindow[medianNext] = distance;
+  medianNext = (medianNext + 1) % TRACK_MEDIAN_WINDOW;
+  if (medianCount < TRACK_MEDIAN_WINDOW) medianCount++;
+  samplesAccepted++;
+}
+
+static unsigned int medianDistance() {
+  unsigned int sorted[TRACK_MEDIAN_WINDOW];
+  memcpy(sorted, medianWindow, medianCount * sizeof(unsigned int));
+  for (size_t i = 1; i < medianCount; i++) {
+    unsigned int value = sorted[i];
+    size_t j = i;
+    for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = value;
+  }
+  return sorted[medianCount / 2];
+}
+
+// Alpha-beta filter step on an outlier-filtered distance
+static void updateTrack(unsigned int measured, uint32_t now) {
+  SensorTrack next = getSensorTrack();
+  uint32_t dt = now - next.timestamp;
+
+  if (next.confidence == 0 || dt > TRACK_RESET_TIMEOUT) {
+    // No recent track: restart at the measurement
+    next.position = measured;
+    next.velocity = 0.0f;
+    next.confidence = 1;
+  } else {
+    float dtSeconds = dt / 1000.0f;
+    float predicted = next.position + next.velocity * dtSeconds;
+    float residual = (float)measured - predicted;
+
+    next.position = predicted + TRACK_ALPHA * residual;
+    if (dt > 0) {
+      next.velocity += (TRACK_BETA / dtSeconds) * residual;
+    }
+
+    if (fabsf(residual) <= TRACK_GATE) {
+      next.confidence = min(100, next.confidence + 10);
+    } else {
+      next.confidence = max(1, next.confidence - 20);
+    }
+  }
+  next.timestamp = now;
+
+  portENTER_CRITICAL(&trackMux);
+  track = next;
+  portEXIT_CRITICAL(&trackMux);
+}
+
+static void lostSync() {
+  if (parserSynced) {
+    sensorStats.resyncs++;
+    parserSynced = false;
+  }
+}
+
+static bool payloadValid() {
+#if SENSOR_CHECKSUM
+  uint8_t sum = 0;
+  for (size_t i = 0; i < SENSOR_PAYLOAD_LENGTH - 1; i++) sum += payload[i];
+  return sum == payload[SENSOR_PAYLOAD_LENGTH - 1];
+#else
+  return true;
+#endif
+}
+
+static void parseByte(uint8_t c, unsigned int &distance);
+
+// A complete frame is in payload[]. On a checksum failure the frame is
+// scanned again from its second byte, so a real header hidden inside the bad
+// frame is found, including one starting at the second header byte.
+static void finishFrame(unsigned int &distance) {
+  parserState = WAIT_HEADER1;
+  payloadLength = 0;
+
+  if (!payloadValid()) {
+    sensorStats.checksumErrors++;
+    lostSync();
+
+    uint8_t rescan[SENSOR_PAYLOAD_LENGTH + 1];
+    rescan[0] = SENSOR_HEADER;
+    memcpy(rescan + 1, payload, SENSOR_PAYLOAD_LENGTH);
+    for (size_t i = 0; i < sizeof(rescan); i++) parseByte(rescan[i], distance);
+    return;
+  }
+
+  parserSynced = true;
+  sensorStats.goodFrames++;
+
+  unsigned int value = (payload[2] << 8) | payload[1];
+  if (value < MIN_DISTANCE || value > MAX_DISTANCE) {
+    sensorStats.outOfRange++;
+    return;
+  }
+  distance = value;
+  acceptSample(value);
+}
+
+static void parseByte(uint8_t c, unsigned int &distance) {
+  switch (parserState) {
+    case WAIT_HEADER1:
+      if (c == SENSOR_HEADER) {
+        parserState = WAIT_HEADER2;
+      } else {
+        lostSync();
+      }
+      break;
+
+    case WAIT_HEADER2:
+      if (c == SENSOR_HEADER) {
+        parserState = READ_PAYLOAD;
+        payloadLength = 0;
+      } else {
+        lostSync();
+        parserState = WAIT_HEADER1;
+      }
+      break;
+
+    case READ_PAYLOAD:
+      payload[payloadLength++] = c;
+      if (payloadLength == SENSOR_PAYLOAD_LENGTH) {
+        finishFrame(distance);
+      }
+      break;
+  }
+}
+
 unsigned int readSensorData() {
 #ifndef SIMULATE_SENSOR
-  if (Serial1.available() < 7) return g_sensorDistance;
-  
-  if (Serial1.read() != SENSOR_HEADER) {
-    while (Serial1.available()) Serial1.read();
-    return g_sensorDistance;
-  }
-  
-  if (Serial1.read() != SENSOR_HEADER) {
-    while (Serial1.available()) Serial1.read();
-    return g_sensorDistance;
-  }
-  
-  byte buf[5];
-  size_t bytesRead = Serial1.readBytes(buf, 5);
-  
-  if (bytesRead < 5) return g_sensorDistance;
-  
-  unsigned int distance = (buf[2] << 8) | buf[1];
-  if (distance < MIN_DISTANCE || distance > MAX_DISTANCE) return g_sensorDistance;
-  
+  unsigned int distance = g_sensorDistance;
+
+  // Parse every byte received so far; never waits for the rest of a frame
+  drainUart();
+  while (rxCount > 0) {
+    uint8_t c = rxBuffer[rxHead];
+    rxHead = (rxHead + 1) % SENSOR_RX_BUFFER_SIZE;
+    rxCount--;
+    parseByte(c, distance);
+
+    if (rxCount == 0) drainUart();
+  }
+
   return distance;
 #else
   static unsigned int simulatedDistance = MIN_DISTANCE;
   simulatedDistance += 10;
   if (simulatedDistance > MAX_DISTANCE) simulatedDistance = MIN_DISTANCE;
+  acceptSample(simulatedDistance);
   return simulatedDistance;
 #endif
 }
 
+bool processSensorData() {
+  uint32_t acceptedBefore = samplesAccepted;
+  unsigned int newDistance = readSensorData();
+  if (samplesAccepted == acceptedBefore) return false;
+
+  uint32_t now = millis();
+  g_sensorDistance = newDistance;
+  g_sensorTimestamp = now;
+
+  // The median only rejects outliers; feeding it to the filter directly
+  // would delay a moving target by half the median window
+  unsigned int median = medianDistance();
+  unsigned int measured = (abs((int)newDistance - (int)median) > TRACK_GATE) ? median : newDistance;
+  updateTrack(measured, now);
+  recordSample(newDistance, getSensorTrack().position, now);
+
+  if (sensorListener != NULL) {
+    xTaskNotify(sensorListener, now, eSetValueWithOverwrite);
+  }
+  return true;
+}
+
 void sensorTask(void * parameter) {
+  sensorTaskHandle = xTaskGetCurrentTaskHandle();
+
   for (;;) {
-    unsigned int newDistance = readSensorData();
-    g_sensorDistance = newDistance;
+#ifndef SIMULATE_SENSOR
+    // Sleep until the UART reports received bytes
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
     vTaskDelay(pdMS_TO_TICKS(5));
+#endif
+
+    processSensorData();
   }
-}
\ No newline at end of file
+}
@@ -3,16 +3,68 @@
 
 #include <Arduino.h>
 
+// Sensor parser counters
+struct SensorStats {
+  uint32_t goodFrames;      // frames with a valid header and checksum
+  uint32_t resyncs;         // times the parser lost frame sync and had to search for a header
+  uint32_t checksumErrors;  // complete frames rejected by the checksum
+  uint32_t outOfRange;      // valid frames with a distance outside MIN_DISTANCE..MAX_DISTANCE
+};
+
+// One accepted distance and the filtered position after it; sequence
+// numbers start at 1 and never repeat
+struct SensorSample {
+  uint32_t sequence;
+  uint32_t timestamp;   // millis()
+  uint16_t distance;    // raw
+  float position;       // tracking filter output
+};
+
+// Output of the tracking filter
+struct SensorTrack {
+  float position;       // filtered distance
+  float velocity;       // distance units per second, positive = moving away from the sensor
+  uint8_t confidence;   // 0 = no track yet, up to 100 for a steady, consistent track
+  uint32_t timestamp;   // millis() of the last update
+};
+
 // Initialize the sensor
 void initSensor();
 
 // Get current sensor distance
 unsigned int getSensorDistance();
 
+// Time (millis) the current sensor distance was received
+uint32_t getSensorTimestamp();
+
+// Task to notify when a new distance is available; the notification value
+// is the sample timestamp (millis)
+void setSensorListener(TaskHandle_t task);
+
 // Sensor task function
 void sensorTask(void * parameter);
 
-// Read raw sensor data
+// Parse all sensor bytes received so far without blocking; returns the
+// latest valid distance (or the current one if no new frame arrived)
 unsigned int readSensorData();
 
+// Parse pending sensor data and, if a new distance arrived, update the
+// tracking filter and notify the listener. Returns true on a new sample.
+bool processSensorData();
+
+// Get the filtered position, velocity and confidence; a track with no sample
+// for TRACK_RESET_TIMEOUT keeps its position but reports velocity and
+// confidence 0
+SensorTrack getSensorTrack();
+
+// Copy up to max samples newer than sequence after, oldest first. Only the
+// last SENSOR_HISTORY_SIZE samples are kept; older ones are skipped.
+size_t getSensorSamples(uint32_t after, SensorSample *out, size_t max);
+
+// Sequence number of the newest sample (0 before the first one)
+uint32_t getSensorSequence();
+
+// Get parser counters
+SensorStats getSensorStats();
+
 #endif // SENSOR_MANAGER_H
\ No newline at end of file
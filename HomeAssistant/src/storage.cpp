@@ -1,8 +1,10 @@
 #include "storage.h"
 #include "config.h"
+#include "log.h"
 #include <EEPROM.h>
 #include <Preferences.h>
 #include <Arduino.h>
+#include <atomic>
 
 Preferences preferences;
 
@@ -16,6 +18,7 @@ static int additionalLEDs = DEFAULT_ADDITIONAL_LEDS;
 static CRGB baseColor = DEFAULT_BASE_COLOR;
 static float speedMultiplier = DEFAULT_SPEED_MULTIPLIER;
 static int ledOffDelay = DEFAULT_LED_OFF_DELAY;
+static int numLeds = DEFAULT_NUM_LEDS;
 
 // Time and Schedule Parameters
 static int startHour = DEFAULT_START_HOUR;
@@ -27,80 +30,489 @@ static bool lightOn = true;
 // Background Light Mode
 static bool backgroundModeActive = false;
 
-// WiFi settings
-static String wifi_ssid = "";
-static String wifi_password = "";
+// Render parameter snapshot, published as a seqlock: a writer makes
+// renderSeq odd, updates the copy and makes it even again; readers retry
+// until they see the same even value before and after copying.
+static RenderParams renderParams;
+static std::atomic<uint32_t> renderSeq(0);
+static uint32_t renderGeneration = 0;
+static portMUX_TYPE renderParamsMux = portMUX_INITIALIZER_UNLOCKED;
 
-// MQTT settings
-static String mqtt_server = "";
-static int mqtt_port = 1883;
-static String mqtt_user = "";
-static String mqtt_password = "";
+// Task notified whenever a new snapshot is published
+static TaskHandle_t renderParamsListener = NULL;
+
+// Changes not yet picked up by takeStateChanges(), as SETTING_* bits
+static std::atomic<uint32_t> stateChanges(0);
+static TaskHandle_t stateListener = NULL;
+
+// Write-behind: setters only mark the settings dirty and storageTask commits
+// them once changes have been quiet for a while, so a burst of slider moves
+// or MQTT fields costs one flash write instead of one per change
+static bool settingsDirty = false;
+static bool flushRequested = false;   // write on the next pass, don't wait for quiet
+static unsigned long firstDirtyTime = 0;
+static unsigned long lastDirtyTime = 0;
+static portMUX_TYPE settingsDirtyMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t storageTaskHandle = NULL;
+
+// Flash writes of the settings record
+static std::atomic<uint32_t> settingsCommits(0);
+static std::atomic<uint32_t> settingsCommitFailures(0);
+
+// WiFi and MQTT credentials, kept in fixed-size buffers so they can be
+// copied into the settings record without allocating
+static char wifi_ssid[33] = "";
+static char wifi_password[65] = "";
+static char mqtt_server[65] = "";
+static int mqtt_port = MQTT_PORT;
+static char mqtt_user[65] = "";
+static char mqtt_password[65] = "";
+static portMUX_TYPE credentialsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Persistent settings: one packed record stored as a single NVS blob. The
+// header carries a magic, the layout version, the payload length and a
+// CRC-32 of the payload. New fields are only ever appended to the payload,
+// so an older record is read as a prefix and the rest keeps its defaults;
+// conversions for fields whose meaning changed go in migrateSettings().
+#define SETTINGS_KEY      "settings"
+#define SETTINGS_MAGIC    0x4C545253UL   // "LTRS"
+#define SETTINGS_VERSION  2
+
+struct __attribute__((packed)) SettingsHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint32_t crc;
+};
+
+struct __attribute__((packed)) SettingsPayload {
+  // Version 1
+  int32_t updateInterval;
+  int32_t ledOffDelay;
+  float movingIntensity;
+  float stationaryIntensity;
+  int32_t movingLength;
+  int32_t centerShift;
+  int32_t additionalLEDs;
+  uint8_t baseColor[3];
+  float speedMultiplier;
+  uint8_t startHour;
+  uint8_t startMinute;
+  uint8_t endHour;
+  uint8_t endMinute;
+  char wifiSsid[sizeof(wifi_ssid)];
+  char wifiPassword[sizeof(wifi_password)];
+  char mqttServer[sizeof(mqtt_server)];
+  uint16_t mqttPort;
+  char mqttUser[sizeof(mqtt_user)];
+  char mqttPassword[sizeof(mqtt_password)];
+  // Version 2
+  uint16_t numLeds;
+};
+
+struct __attribute__((packed)) SettingsRecord {
+  SettingsHeader header;
+  SettingsPayload data;
+};
+
+static void publishRenderParams() {
+  portENTER_CRITICAL(&renderParamsMux);
+  uint32_t seq = renderSeq.load(std::memory_order_relaxed);
+  renderSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  renderParams.generation = ++renderGeneration;
+  renderParams.lightOn = lightOn;
+  renderParams.backgroundMode = backgroundModeActive;
+  renderParams.updateInterval = updateInterval;
+  renderParams.ledOffDelay = ledOffDelay;
+  renderParams.movingIntensity = movingIntensity;
+  renderParams.stationaryIntensity = stationaryIntensity;
+  renderParams.movingLength = movingLength;
+  renderParams.centerShift = centerShift;
+  renderParams.additionalLEDs = additionalLEDs;
+  renderParams.baseColor = baseColor;
+  renderParams.speedMultiplier = speedMultiplier;
+
+  renderSeq.store(seq + 2, std::memory_order_release);
+  portEXIT_CRITICAL(&renderParamsMux);
+
+  if (renderParamsListener != NULL) {
+    xTaskNotify(renderParamsListener, 0, eNoAction);
+  }
+}
+
+void setRenderParamsListener(TaskHandle_t task) {
+  renderParamsListener = task;
+}
+
+static void markStateChanged(uint32_t fields) {
+  stateChanges.fetch_or(fields, std::memory_order_relaxed);
+  if (stateListener != NULL) {
+    xTaskNotifyGive(stateListener);
+  }
+}
+
+uint32_t takeStateChanges() {
+  return stateChanges.exchange(0, std::memory_order_relaxed);
+}
+
+void setStateListener(TaskHandle_t task) {
+  stateListener = task;
+}
+
+void getRenderParams(RenderParams &params) {
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = renderSeq.load(std::memory_order_acquire);
+    params = renderParams;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = renderSeq.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
+
+static uint32_t crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static void copyString(char *dest, size_t size, const char *src) {
+  strncpy(dest, src, size - 1);
+  dest[size - 1] = '\0';
+}
+
+static void defaultPayload(SettingsPayload &data) {
+  memset(&data, 0, sizeof(data));
+  data.updateInterval = DEFAULT_UPDATE_INTERVAL;
+  data.ledOffDelay = DEFAULT_LED_OFF_DELAY;
+  data.movingIntensity = DEFAULT_MOVING_INTENSITY;
+  data.stationaryIntensity = DEFAULT_STATIONARY_INTENSITY;
+  data.movingLength = DEFAULT_MOVING_LENGTH;
+  data.centerShift = DEFAULT_CENTER_SHIFT;
+  data.additionalLEDs = DEFAULT_ADDITIONAL_LEDS;
+  CRGB color = DEFAULT_BASE_COLOR;
+  data.baseColor[0] = color.r;
+  data.baseColor[1] = color.g;
+  data.baseColor[2] = color.b;
+  data.speedMultiplier = DEFAULT_SPEED_MULTIPLIER;
+  data.startHour = DEFAULT_START_HOUR;
+  data.startMinute = DEFAULT_START_MINUTE;
+  data.endHour = DEFAULT_END_HOUR;
+  data.endMinute = DEFAULT_END_MINUTE;
+  copyString(data.wifiSsid, sizeof(data.wifiSsid), "MySSID");
+  copyString(data.wifiPassword, sizeof(data.wifiPassword), "MyPass");
+  copyString(data.mqttServer, sizeof(data.mqttServer), "192.168.1.100");
+  data.mqttPort = MQTT_PORT;
+  copyString(data.mqttUser, sizeof(data.mqttUser), "user");
+  copyString(data.mqttPassword, sizeof(data.mqttPassword), "pass");
+  data.numLeds = DEFAULT_NUM_LEDS;
+}
+
+// Convert a record written by an older firmware to the current meaning of
+// its fields. Appended fields need nothing here, they keep their defaults.
+static void migrateSettings(SettingsPayload &data, uint16_t fromVersion) {
+  switch (fromVersion) {
+    case 1:
+      // Version 2 appended numLeds, which keeps its default
+      // fall through
+    case 2:
+      // Current layout
+      break;
+  }
+}
+
+// Valid ranges, shared by the record check on load and by applySettings();
+// written so that NaN fails them
+static bool validUpdateInterval(int value) { return value >= 1 && value <= 1000; }
+static bool validLedOffDelay(int value) { return value >= 0 && value <= 3600; }
+static bool validMovingIntensity(float value) { return value >= 0.0f && value <= 1.0f; }
+static bool validStationaryIntensity(float value) { return value >= 0.0f && value <= 0.07f; }
+static bool validMovingLength(int value) { return value >= 1 && value <= MAX_NUM_LEDS; }
+static bool validCenterShift(int value) { return value >= -MAX_NUM_LEDS && value <= MAX_NUM_LEDS; }
+static bool validAdditionalLEDs(int value) { return value >= 0 && value <= MAX_NUM_LEDS; }
+static bool validSpeedMultiplier(float value) { return value >= 0.0f && value <= MAX_SPEED_MULTIPLIER; }
+static bool validNumLeds(int value) { return value >= 1 && value <= MAX_NUM_LEDS; }
+static bool validHour(int value) { return value >= 0 && value <= 23; }
+static bool validMinute(int value) { return value >= 0 && value <= 59; }
+
+// Replace anything out of range (including NaN) with its default, so a
+// damaged or hand-edited value can never reach the renderer
+static void sanitizePayload(SettingsPayload &data) {
+  SettingsPayload defaults;
+  defaultPayload(defaults);
+
+  if (!validUpdateInterval(data.updateInterval)) data.updateInterval = defaults.updateInterval;
+  if (!validLedOffDelay(data.ledOffDelay)) data.ledOffDelay = defaults.ledOffDelay;
+  if (!validMovingIntensity(data.movingIntensity)) data.movingIntensity = defaults.movingIntensity;
+  if (!validStationaryIntensity(data.stationaryIntensity)) data.stationaryIntensity = defaults.stationaryIntensity;
+  if (!validMovingLength(data.movingLength)) data.movingLength = defaults.movingLength;
+  if (!validCenterShift(data.centerShift)) data.centerShift = defaults.centerShift;
+  if (!validAdditionalLEDs(data.additionalLEDs)) data.additionalLEDs = defaults.additionalLEDs;
+  if (!validSpeedMultiplier(data.speedMultiplier)) data.speedMultiplier = defaults.speedMultiplier;
+  if (!validNumLeds(data.numLeds)) data.numLeds = defaults.numLeds;
+  if (!validHour(data.startHour)) data.startHour = defaults.startHour;
+  if (!validMinute(data.startMinute)) data.startMinute = defaults.startMinute;
+  if (!validHour(data.endHour)) data.endHour = defaults.endHour;
+  if (!validMinute(data.endMinute)) data.endMinute = defaults.endMinute;
+
+  data.wifiSsid[sizeof(data.wifiSsid) - 1] = '\0';
+  data.wifiPassword[sizeof(data.wifiPassword) - 1] = '\0';
+  data.mqttServer[sizeof(data.mqttServer) - 1] = '\0';
+  data.mqttUser[sizeof(data.mqttUser) - 1] = '\0';
+  data.mqttPassword[sizeof(data.mqttPassword) - 1] = '\0';
+}
+
+static void applyPayload(const SettingsPayload &data) {
+  updateInterval = data.updateInterval;
+  ledOffDelay = data.ledOffDelay;
+  movingIntensity = data.movingIntensity;
+  stationaryIntensity = data.stationaryIntensity;
+  movingLength = data.movingLength;
+  centerShift = data.centerShift;
+  additionalLEDs = data.additionalLEDs;
+  baseColor = CRGB(data.baseColor[0], data.baseColor[1], data.baseColor[2]);
+  speedMultiplier = data.speedMultiplier;
+  numLeds = data.numLeds;
+  startHour = data.startHour;
+  startMinute = data.startMinute;
+  endHour = data.endHour;
+  endMinute = data.endMinute;
+
+  portENTER_CRITICAL(&credentialsMux);
+  memcpy(wifi_ssid, data.wifiSsid, sizeof(wifi_ssid));
+  memcpy(wifi_password, data.wifiPassword, sizeof(wifi_password));
+  memcpy(mqtt_server, data.mqttServer, sizeof(mqtt_server));
+  mqtt_port = data.mqttPort;
+  memcpy(mqtt_user, data.mqttUser, sizeof(mqtt_user));
+  memcpy(mqtt_password, data.mqttPassword, sizeof(mqtt_password));
+  portEXIT_CRITICAL(&credentialsMux);
+}
+
+static void collectPayload(SettingsPayload &data) {
+  memset(&data, 0, sizeof(data));
+  data.updateInterval = updateInterval;
+  data.ledOffDelay = ledOffDelay;
+  data.movingIntensity = movingIntensity;
+  data.stationaryIntensity = stationaryIntensity;
+  data.movingLength = movingLength;
+  data.centerShift = centerShift;
+  data.additionalLEDs = additionalLEDs;
+  data.baseColor[0] = baseColor.r;
+  data.baseColor[1] = baseColor.g;
+  data.baseColor[2] = baseColor.b;
+  data.speedMultiplier = speedMultiplier;
+  data.numLeds = numLeds;
+  data.startHour = startHour;
+  data.startMinute = startMinute;
+  data.endHour = endHour;
+  data.endMinute = endMinute;
+
+  portENTER_CRITICAL(&credentialsMux);
+  memcpy(data.wifiSsid, wifi_ssid, sizeof(wifi_ssid));
+  memcpy(data.wifiPassword, wifi_password, sizeof(wifi_password));
+  memcpy(data.mqttServer, mqtt_server, sizeof(mqtt_server));
+  data.mqttPort = mqtt_port;
+  memcpy(data.mqttUser, mqtt_user, sizeof(mqtt_user));
+  memcpy(data.mqttPassword, mqtt_password, sizeof(mqtt_password));
+  portEXIT_CRITICAL(&credentialsMux);
+}
+
+// Display and schedule values at the fixed EEPROM offsets used before the
+// versioned record
+static void loadLegacyEeprom(SettingsPayload &data) {
+  // Packed fields can't be bound to EEPROM.get's reference, read into locals
+  int32_t legacyInterval, legacyOffDelay, legacyLength, legacyShift, legacyAdditional;
+  int32_t legacyStartHour, legacyStartMinute, legacyEndHour, legacyEndMinute;
+  float legacyMoving, legacyStationary, legacySpeed;
+  CRGB legacyColor;
 
-void initStorage() {
   EEPROM.begin(EEPROM_SIZE);
+  int offset = 0;
+  EEPROM.get(offset, legacyInterval); offset += sizeof(legacyInterval);
+  EEPROM.get(offset, legacyOffDelay); offset += sizeof(legacyOffDelay);
+  EEPROM.get(offset, legacyMoving); offset += sizeof(legacyMoving);
+  EEPROM.get(offset, legacyStationary); offset += sizeof(legacyStationary);
+  EEPROM.get(offset, legacyLength); offset += sizeof(legacyLength);
+  EEPROM.get(offset, legacyShift); offset += sizeof(legacyShift);
+  EEPROM.get(offset, legacyAdditional); offset += sizeof(legacyAdditional);
+  EEPROM.get(offset, legacyColor); offset += sizeof(legacyColor);
+  EEPROM.get(offset, legacySpeed); offset += sizeof(legacySpeed);
+  EEPROM.get(offset, legacyStartHour); offset += sizeof(legacyStartHour);
+  EEPROM.get(offset, legacyStartMinute); offset += sizeof(legacyStartMinute);
+  EEPROM.get(offset, legacyEndHour); offset += sizeof(legacyEndHour);
+  EEPROM.get(offset, legacyEndMinute);
+
+  data.updateInterval = legacyInterval;
+  data.ledOffDelay = legacyOffDelay;
+  data.movingIntensity = legacyMoving;
+  data.stationaryIntensity = legacyStationary;
+  data.movingLength = legacyLength;
+  data.centerShift = legacyShift;
+  data.additionalLEDs = legacyAdditional;
+  data.baseColor[0] = legacyColor.r;
+  data.baseColor[1] = legacyColor.g;
+  data.baseColor[2] = legacyColor.b;
+  data.speedMultiplier = legacySpeed;
+  // Out-of-range values become 0xFF so sanitizePayload() restores the default
+  data.startHour = (legacyStartHour >= 0 && legacyStartHour <= 23) ? legacyStartHour : 0xFF;
+  data.startMinute = (legacyStartMinute >= 0 && legacyStartMinute <= 59) ? legacyStartMinute : 0xFF;
+  data.endHour = (legacyEndHour >= 0 && legacyEndHour <= 23) ? legacyEndHour : 0xFF;
+  data.endMinute = (legacyEndMinute >= 0 && legacyEndMinute <= 59) ? legacyEndMinute : 0xFF;
+}
+
+// Read the settings of firmware before the versioned record: display and
+// schedule values from EEPROM, credentials from separate NVS keys
+static void loadLegacySettings(SettingsPayload &data) {
+  SettingsPayload legacy = data;
+  loadLegacyEeprom(legacy);
+
+  // A blank EEPROM (never saved) reads as zeros; keep the defaults then
+  if ((legacy.updateInterval >= 1 && legacy.updateInterval <= 1000) ||
+      (legacy.movingLength >= 1 && legacy.movingLength <= MAX_NUM_LEDS)) {
+    data = legacy;
+  }
+
+  if (preferences.isKey("wifi_ssid")) {
+    copyString(data.wifiSsid, sizeof(data.wifiSsid), preferences.getString("wifi_ssid").c_str());
+    copyString(data.wifiPassword, sizeof(data.wifiPassword), preferences.getString("wifi_password").c_str());
+  }
+  if (preferences.isKey("mqtt_server")) {
+    copyString(data.mqttServer, sizeof(data.mqttServer), preferences.getString("mqtt_server").c_str());
+    data.mqttPort = preferences.getInt("mqtt_port", MQTT_PORT);
+    copyString(data.mqttUser, sizeof(data.mqttUser), preferences.getString("mqtt_user").c_str());
+    copyString(data.mqttPassword, sizeof(data.mqttPassword), preferences.getString("mqtt_password").c_str());
+  }
+}
+
+void initStorage() {
   preferences.begin("lighttrack", false);
   loadSettings();
+}
+
+// Load the settings record, falling back to the legacy layout on first boot
+// after an upgrade and to defaults if the record is damaged
+void loadSettings() {
+  SettingsRecord record;
+  defaultPayload(record.data);
+  bool valid = false;
+  bool legacy = false;
 
-  // Load WiFi settings
-  wifi_ssid = preferences.getString("wifi_ssid", "");
-  wifi_password = preferences.getString("wifi_password", "");
-//Added to avoid [E][Preferences.cpp:483] getString(): nvs_get_str len fail: wifi_ssid (etc.) NOT_FOUND after first boot
-  if (wifi_ssid.isEmpty() || wifi_password.isEmpty()) {
-    Serial.println("WiFi settings not found, saving defaults.");
-    saveWiFiSettings("MySSID", "MyPass");
+  size_t stored = preferences.getBytes(SETTINGS_KEY, &record, sizeof(record));
+  if (stored >= sizeof(SettingsHeader)) {
+    const SettingsHeader &header = record.header;
+    valid = header.magic == SETTINGS_MAGIC &&
+            header.version >= 1 && header.version <= SETTINGS_VERSION &&
+            stored == sizeof(SettingsHeader) + header.length &&
+            header.crc == crc32((const uint8_t *)&record.data, header.length);
+    if (valid) {
+      migrateSettings(record.data, header.version);
+    } else {
+      LOG_WARN("Settings record invalid, using defaults.");
+      defaultPayload(record.data);
+    }
+  } else if (!preferences.isKey(SETTINGS_KEY)) {
+    LOG_INFO("Settings record not found, migrating legacy settings.");
+    loadLegacySettings(record.data);
+    legacy = true;
+  } else {
+    // A record too large for this layout comes from newer firmware
+    LOG_WARN("Settings record not readable, using defaults.");
   }
 
-  // Load MQTT settings
-  mqtt_server = preferences.getString("mqtt_server", "");
-  mqtt_port = preferences.getInt("mqtt_port", 1883);
-  mqtt_user = preferences.getString("mqtt_user", "");
-  mqtt_password = preferences.getString("mqtt_password", "");
-//Added to avoid [E][Preferences.cpp:483] getString(): nvs_get_str len fail: mqtt_server (etc.)  NOT_FOUND after first boot
-  if (mqtt_server.isEmpty()) {
-    Serial.println("MQTT settings not found, saving defaults.");
-    saveMqttSettings("192.168.1.100", 1883, "user", "pass");
+  sanitizePayload(record.data);
+  applyPayload(record.data);
+  publishRenderParams();
+
+  if (!valid) {
+    saveSettings();
+  }
+  if (legacy) {
+    const char *legacyKeys[] = { "wifi_ssid", "wifi_password", "mqtt_server", "mqtt_port", "mqtt_user", "mqtt_password" };
+    for (const char *key : legacyKeys) {
+      preferences.remove(key);
+    }
   }
 }
 
-// Load EEPROM-based settings
-void loadSettings() {
-  int offset = 0;
-  EEPROM.get(offset, updateInterval); offset += sizeof(updateInterval);
-  EEPROM.get(offset, ledOffDelay); offset += sizeof(ledOffDelay);
-  EEPROM.get(offset, movingIntensity); offset += sizeof(movingIntensity);
-  EEPROM.get(offset, stationaryIntensity); offset += sizeof(stationaryIntensity);
-  EEPROM.get(offset, movingLength); offset += sizeof(movingLength);
-  EEPROM.get(offset, centerShift); offset += sizeof(centerShift);
-  int temp = additionalLEDs;
-  EEPROM.get(offset, temp); additionalLEDs = temp; offset += sizeof(temp);
-  EEPROM.get(offset, baseColor); offset += sizeof(baseColor);
-  offset += sizeof(speedMultiplier); // reserved
-  EEPROM.get(offset, startHour); offset += sizeof(startHour);
-  EEPROM.get(offset, startMinute); offset += sizeof(startMinute);
-  EEPROM.get(offset, endHour); offset += sizeof(endHour);
-  EEPROM.get(offset, endMinute);
-}
-
-// Save EEPROM-based settings
+// Write the current settings as one record
 void saveSettings() {
-  EEPROM.begin(EEPROM_SIZE);
-  int offset = 0;
-  EEPROM.put(offset, updateInterval); offset += sizeof(updateInterval);
-  EEPROM.put(offset, ledOffDelay); offset += sizeof(ledOffDelay);
-  EEPROM.put(offset, movingIntensity); offset += sizeof(movingIntensity);
-  EEPROM.put(offset, stationaryIntensity); offset += sizeof(stationaryIntensity);
-  EEPROM.put(offset, movingLength); offset += sizeof(movingLength);
-  EEPROM.put(offset, centerShift); offset += sizeof(centerShift);
-  int temp = additionalLEDs;
-  EEPROM.put(offset, temp); offset += sizeof(temp);
-  EEPROM.put(offset, baseColor); offset += sizeof(baseColor);
-  offset += sizeof(speedMultiplier); // reserved
-  EEPROM.put(offset, startHour); offset += sizeof(startHour);
-  EEPROM.put(offset, startMinute); offset += sizeof(startMinute);
-  EEPROM.put(offset, endHour); offset += sizeof(endHour);
-  EEPROM.put(offset, endMinute);
-  EEPROM.commit();
+  SettingsRecord record;
+  collectPayload(record.data);
+  record.header.magic = SETTINGS_MAGIC;
+  record.header.version = SETTINGS_VERSION;
+  record.header.length = sizeof(SettingsPayload);
+  record.header.crc = crc32((const uint8_t *)&record.data, sizeof(SettingsPayload));
+
+  if (preferences.putBytes(SETTINGS_KEY, &record, sizeof(record)) != sizeof(record)) {
+    settingsCommitFailures.fetch_add(1, std::memory_order_relaxed);
+    LOG_ERROR("Failed to save settings.");
+  } else {
+    settingsCommits.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+StorageStats getStorageStats() {
+  StorageStats stats;
+  stats.commits = settingsCommits.load(std::memory_order_relaxed);
+  stats.commitFailures = settingsCommitFailures.load(std::memory_order_relaxed);
+  return stats;
+}
+
+static void markSettingsDirty() {
+  unsigned long now = millis();
+  portENTER_CRITICAL(&settingsDirtyMux);
+  if (!settingsDirty) {
+    settingsDirty = true;
+    firstDirtyTime = now;
+  }
+  lastDirtyTime = now;
+  portEXIT_CRITICAL(&settingsDirtyMux);
+}
+
+// Have storageTask write the pending changes now rather than after the quiet
+// period, for callers that must not block on a flash write themselves
+static void requestSettingsFlush() {
+  portENTER_CRITICAL(&settingsDirtyMux);
+  flushRequested = true;
+  portEXIT_CRITICAL(&settingsDirtyMux);
+  if (storageTaskHandle != NULL) {
+    xTaskNotifyGive(storageTaskHandle);
+  }
+}
+
+bool flushSettings(bool force) {
+  unsigned long now = millis();
+  portENTER_CRITICAL(&settingsDirtyMux);
+  bool due = settingsDirty &&
+             (force || flushRequested ||
+              now - lastDirtyTime >= SETTINGS_FLUSH_QUIET ||
+              now - firstDirtyTime >= SETTINGS_FLUSH_MAX_DELAY);
+  // Clear before writing, so a change made during the write marks it dirty again
+  if (due) {
+    settingsDirty = false;
+    flushRequested = false;
+  }
+  portEXIT_CRITICAL(&settingsDirtyMux);
+
+  if (!due) return false;
+  saveSettings();
+  return true;
+}
+
+void storageTask(void * parameter) {
+  storageTaskHandle = xTaskGetCurrentTaskHandle();
+  for (;;) {
+    flushSettings();
+    // Woken early by requestSettingsFlush()
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETTINGS_FLUSH_POLL));
+  }
 }
 
 // Getters
@@ -113,6 +525,7 @@ int getCenterShift() { return centerShift; }
 int getAdditionalLEDs() { return additionalLEDs; }
 CRGB getBaseColor() { return baseColor; }
 float getSpeedMultiplier() { return speedMultiplier; }
+int getNumLeds() { return numLeds; }
 int getStartHour() { return startHour; }
 int getStartMinute() { return startMinute; }
 int getEndHour() { return endHour; }
@@ -121,58 +534,175 @@ bool isLightOn() { return lightOn; }
 bool isBackgroundModeActive() { return backgroundModeActive; }
 
 // Setters
-void setUpdateInterval(int value) { updateInterval = value; saveSettings(); }
-void setLedOffDelay(int value) { ledOffDelay = value; saveSettings(); }
-void setMovingIntensity(float value) { movingIntensity = value; saveSettings(); }
+void setUpdateInterval(int value) {
+  updateInterval = value;
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_UPDATE_INTERVAL);
+}
+void setLedOffDelay(int value) {
+  ledOffDelay = value;
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_LED_OFF_DELAY);
+}
+void setMovingIntensity(float value) {
+  movingIntensity = value;
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_MOVING_INTENSITY);
+}
 void setStationaryIntensity(float value) {
   value = constrain(value < 0.01 ? 0.0 : value, 0.0, 0.07);
   stationaryIntensity = value;
-  saveSettings();
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_STATIONARY_INTENSITY);
+}
+void setMovingLength(int value) {
+  movingLength = value;
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_MOVING_LENGTH);
+}
+void setCenterShift(int value) {
+  centerShift = value;
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_CENTER_SHIFT);
+}
+void setAdditionalLEDs(int value) {
+  additionalLEDs = value;
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_ADDITIONAL_LEDS);
+}
+void setBaseColor(CRGB color) {
+  baseColor = color;
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_BASE_COLOR);
+}
+void setSpeedMultiplier(float value) {
+  speedMultiplier = constrain(value, 0.0, MAX_SPEED_MULTIPLIER);
+  publishRenderParams();
+  markSettingsDirty();
+  markStateChanged(SETTING_SPEED_MULTIPLIER);
 }
-void setMovingLength(int value) { movingLength = value; saveSettings(); }
-void setCenterShift(int value) { centerShift = value; saveSettings(); }
-void setAdditionalLEDs(int value) { additionalLEDs = value; saveSettings(); }
-void setBaseColor(CRGB color) { baseColor = color; saveSettings(); }
-void setSpeedMultiplier(float value) { speedMultiplier = value; saveSettings(); }
-void setStartHour(int value) { startHour = value; saveSettings(); }
-void setStartMinute(int value) { startMinute = value; saveSettings(); }
-void setEndHour(int value) { endHour = value; saveSettings(); }
-void setEndMinute(int value) { endMinute = value; saveSettings(); }
-void setLightOn(bool value) { lightOn = value; }
-void setBackgroundModeActive(bool value) { backgroundModeActive = value; }
-void toggleBackgroundMode() { backgroundModeActive = !backgroundModeActive; }
-
-// WiFi settings
+void setNumLeds(int value) { numLeds = constrain(value, 1, MAX_NUM_LEDS); markSettingsDirty(); markStateChanged(SETTING_NUM_LEDS); }
+void setStartHour(int value) { startHour = value; markSettingsDirty(); markStateChanged(SETTING_SCHEDULE); }
+void setStartMinute(int value) { startMinute = value; markSettingsDirty(); markStateChanged(SETTING_SCHEDULE); }
+void setEndHour(int value) { endHour = value; markSettingsDirty(); markStateChanged(SETTING_SCHEDULE); }
+void setEndMinute(int value) { endMinute = value; markSettingsDirty(); markStateChanged(SETTING_SCHEDULE); }
+void setLightOn(bool value) {
+  // Called every second by the schedule; only publish real changes
+  if (lightOn == value) return;
+  lightOn = value;
+  publishRenderParams();
+  markStateChanged(SETTING_LIGHT_ON);
+}
+void setBackgroundModeActive(bool value) {
+  if (backgroundModeActive == value) return;
+  backgroundModeActive = value;
+  publishRenderParams();
+  markStateChanged(SETTING_BACKGROUND_MODE);
+}
+void toggleBackgroundMode() { setBackgroundModeActive(!backgroundModeActive); }
+
+uint32_t validateSettings(const SettingsUpdate &update) {
+  uint32_t fields = update.fields;
+  if ((fields & SETTING_UPDATE_INTERVAL) && !validUpdateInterval(update.updateInterval)) return SETTING_UPDATE_INTERVAL;
+  if ((fields & SETTING_LED_OFF_DELAY) && !validLedOffDelay(update.ledOffDelay)) return SETTING_LED_OFF_DELAY;
+  if ((fields & SETTING_MOVING_INTENSITY) && !validMovingIntensity(update.movingIntensity)) return SETTING_MOVING_INTENSITY;
+  if ((fields & SETTING_STATIONARY_INTENSITY) && !validStationaryIntensity(update.stationaryIntensity)) return SETTING_STATIONARY_INTENSITY;
+  if ((fields & SETTING_MOVING_LENGTH) && !validMovingLength(update.movingLength)) return SETTING_MOVING_LENGTH;
+  if ((fields & SETTING_CENTER_SHIFT) && !validCenterShift(update.centerShift)) return SETTING_CENTER_SHIFT;
+  if ((fields & SETTING_ADDITIONAL_LEDS) && !validAdditionalLEDs(update.additionalLEDs)) return SETTING_ADDITIONAL_LEDS;
+  if ((fields & SETTING_SPEED_MULTIPLIER) && !validSpeedMultiplier(update.speedMultiplier)) return SETTING_SPEED_MULTIPLIER;
+  if ((fields & SETTING_NUM_LEDS) && !validNumLeds(update.numLeds)) return SETTING_NUM_LEDS;
+  if ((fields & SETTING_SCHEDULE) &&
+      !(validHour(update.startHour) && validMinute(update.startMinute) &&
+        validHour(update.endHour) && validMinute(update.endMinute))) return SETTING_SCHEDULE;
+  return 0;
+}
+
+bool applySettings(const SettingsUpdate &update) {
+  if (validateSettings(update) != 0) return false;
+
+  uint32_t fields = update.fields;
+  if (fields & SETTING_UPDATE_INTERVAL) updateInterval = update.updateInterval;
+  if (fields & SETTING_LED_OFF_DELAY) ledOffDelay = update.ledOffDelay;
+  if (fields & SETTING_MOVING_INTENSITY) movingIntensity = update.movingIntensity;
+  // Same snap to off as setStationaryIntensity()
+  if (fields & SETTING_STATIONARY_INTENSITY) stationaryIntensity = update.stationaryIntensity < 0.01f ? 0.0f : update.stationaryIntensity;
+  if (fields & SETTING_MOVING_LENGTH) movingLength = update.movingLength;
+  if (fields & SETTING_CENTER_SHIFT) centerShift = update.centerShift;
+  if (fields & SETTING_ADDITIONAL_LEDS) additionalLEDs = update.additionalLEDs;
+  if (fields & SETTING_BASE_COLOR) baseColor = update.baseColor;
+  if (fields & SETTING_SPEED_MULTIPLIER) speedMultiplier = update.speedMultiplier;
+  if (fields & SETTING_NUM_LEDS) numLeds = update.numLeds;
+  if (fields & SETTING_SCHEDULE) {
+    startHour = update.startHour;
+    startMinute = update.startMinute;
+    endHour = update.endHour;
+    endMinute = update.endMinute;
+  }
+  if (fields & SETTING_BACKGROUND_MODE) backgroundModeActive = update.backgroundMode;
+
+  publishRenderParams();
+  markStateChanged(fields);
+  // Background mode is not part of the record. This runs on the web server's
+  // task, so the write is left to storageTask, which makes it right away
+  if (fields & ~SETTING_BACKGROUND_MODE) {
+    markSettingsDirty();
+    requestSettingsFlush();
+  }
+  return true;
+}
+
+// Copy a credential under the lock, so a concurrent save can't tear it
+template <size_t N>
+static String readCredential(const char (&field)[N]) {
+  char value[N];
+  portENTER_CRITICAL(&credentialsMux);
+  memcpy(value, field, N);
+  portEXIT_CRITICAL(&credentialsMux);
+  return String(value);
+}
+
+// WiFi settings (written right away: they are usually followed by a restart)
 void saveWiFiSettings(const char* ssid, const char* password) {
-  wifi_ssid = String(ssid);
-  wifi_password = String(password);
-  preferences.putString("wifi_ssid", wifi_ssid);
-  preferences.putString("wifi_password", wifi_password);
-  Serial.println("WiFi settings saved to NVS.");
+  portENTER_CRITICAL(&credentialsMux);
+  copyString(wifi_ssid, sizeof(wifi_ssid), ssid);
+  copyString(wifi_password, sizeof(wifi_password), password);
+  portEXIT_CRITICAL(&credentialsMux);
+  markSettingsDirty();
+  flushSettings(true);
+  LOG_INFO("WiFi settings saved to NVS.");
 }
 
-String getWiFiSSID() { return wifi_ssid; }
-String getWiFiPassword() { return wifi_password; }
-bool hasWiFiSettings() { return wifi_ssid.length() > 0; }
+String getWiFiSSID() { return readCredential(wifi_ssid); }
+String getWiFiPassword() { return readCredential(wifi_password); }
+bool hasWiFiSettings() { return wifi_ssid[0] != '\0'; }
 
-// MQTT settings
+// MQTT settings (saved from the web server's task, so written by storageTask)
 void saveMqttSettings(const char* server, int port, const char* user, const char* password) {
-  mqtt_server = String(server);
+  portENTER_CRITICAL(&credentialsMux);
+  copyString(mqtt_server, sizeof(mqtt_server), server);
   mqtt_port = port;
-  mqtt_user = String(user);
-  mqtt_password = String(password);
-  preferences.putString("mqtt_server", mqtt_server);
-  preferences.putInt("mqtt_port", mqtt_port);
-  preferences.putString("mqtt_user", mqtt_user);
-  preferences.putString("mqtt_password", mqtt_password);
-  Serial.println("MQTT settings saved to NVS.");
+  copyString(mqtt_user, sizeof(mqtt_user), user);
+  copyString(mqtt_password, sizeof(mqtt_password), password);
+  portEXIT_CRITICAL(&credentialsMux);
+  markSettingsDirty();
+  requestSettingsFlush();
+  LOG_INFO("MQTT settings saved.");
 }
 
-String getMqttServer() { return mqtt_server; }
+String getMqttServer() { return readCredential(mqtt_server); }
 int getMqttPort() { return mqtt_port; }
-String getMqttUser() { return mqtt_user; }
-String getMqttPassword() { return mqtt_password; }
-bool hasMqttSettings() { return mqtt_server.length() > 0; }
+String getMqttUser() { return readCredential(mqtt_user); }
+String getMqttPassword() { return readCredential(mqtt_password); }
+bool hasMqttSettings() { return mqtt_server[0] != '\0'; }
 
 // Optional: Reset NVS storage
 /*
@@ -180,6 +710,6 @@ bool hasMqttSettings() { return mqtt_server.length() > 0; }
 void resetNVS() {
   nvs_flash_erase();
   nvs_flash_init();
-  Serial.println("NVS storage erased!");
+  LOG_INFO("NVS storage erased!");
 }
 */
@@ -4,15 +4,107 @@
 #include <Arduino.h>
 #include <FastLED.h>
 
-// Initialize EEPROM storage
+// Settings the LED renderer reads every frame, published as one consistent
+// snapshot. generation changes on every publish, so derived data only needs
+// to be rebuilt when it differs from the last snapshot.
+struct RenderParams {
+  uint32_t generation;
+  bool lightOn;
+  bool backgroundMode;
+  int updateInterval;
+  int ledOffDelay;
+  float movingIntensity;
+  float stationaryIntensity;
+  int movingLength;
+  int centerShift;
+  int additionalLEDs;
+  CRGB baseColor;
+  float speedMultiplier;
+};
+
+// Initialize settings storage
 void initStorage();
 
-// Load settings from EEPROM
+// Load the settings record from NVS (migrating legacy EEPROM settings once)
 void loadSettings();
 
-// Save settings to EEPROM
+// Save all settings to NVS as one versioned, CRC-checked record
 void saveSettings();
 
+// Write pending setting changes if they are due (or right away when forced);
+// returns true if anything was written
+bool flushSettings(bool force = false);
+
+// Writes changed settings in the background, once per burst of changes
+void storageTask(void * parameter);
+
+// Settings record writes to flash
+struct StorageStats {
+  uint32_t commits;
+  uint32_t commitFailures;
+};
+
+StorageStats getStorageStats();
+
+// Take a consistent snapshot of the render settings (lock-free, safe from any task)
+void getRenderParams(RenderParams &params);
+
+// Notify a task (with eNoAction) whenever the render settings change
+void setRenderParamsListener(TaskHandle_t task);
+
+// A batch of setting changes; only the fields whose SETTING_* bit is set in
+// fields are used
+enum SettingsField {
+  SETTING_UPDATE_INTERVAL      = 1 << 0,
+  SETTING_LED_OFF_DELAY        = 1 << 1,
+  SETTING_MOVING_INTENSITY     = 1 << 2,
+  SETTING_STATIONARY_INTENSITY = 1 << 3,
+  SETTING_MOVING_LENGTH        = 1 << 4,
+  SETTING_CENTER_SHIFT         = 1 << 5,
+  SETTING_ADDITIONAL_LEDS      = 1 << 6,
+  SETTING_BASE_COLOR           = 1 << 7,
+  SETTING_SPEED_MULTIPLIER     = 1 << 8,
+  SETTING_NUM_LEDS             = 1 << 9,
+  SETTING_SCHEDULE             = 1 << 10,
+  SETTING_BACKGROUND_MODE      = 1 << 11,
+  SETTING_LIGHT_ON             = 1 << 12    // change reports only; not part of an update
+};
+
+struct SettingsUpdate {
+  uint32_t fields;
+  int updateInterval;
+  int ledOffDelay;
+  float movingIntensity;
+  float stationaryIntensity;
+  int movingLength;
+  int centerShift;
+  int additionalLEDs;
+  CRGB baseColor;
+  float speedMultiplier;
+  int numLeds;
+  int startHour;
+  int startMinute;
+  int endHour;
+  int endMinute;
+  bool backgroundMode;
+};
+
+// Check every field of an update; returns the first one out of range as its
+// SETTING_* bit, or 0 if the update can be applied
+uint32_t validateSettings(const SettingsUpdate &update);
+
+// Apply a valid update as one change: the renderer sees all of it in a single
+// snapshot and storageTask saves it with one write, without waiting for the
+// usual quiet period. Returns false, changing nothing, if validateSettings()
+// rejects it.
+bool applySettings(const SettingsUpdate &update);
+
+// Settings and light state changed since the last call, as SETTING_* bits
+uint32_t takeStateChanges();
+
+// Notify a task (as with xTaskNotifyGive) whenever a setting or the light state changes
+void setStateListener(TaskHandle_t task);
+
 // Getters for settings
 int getUpdateInterval();
 int getLedOffDelay();
@@ -23,6 +115,7 @@ int getCenterShift();
 int getAdditionalLEDs();
 CRGB getBaseColor();
 float getSpeedMultiplier();
+int getNumLeds();
 int getStartHour();
 int getStartMinute();
 int getEndHour();
@@ -40,6 +133,7 @@ void setCenterShift(int value);
 void setAdditionalLEDs(int value);
 void setBaseColor(CRGB color);
 void setSpeedMultiplier(float value);
+void setNumLeds(int value);  // takes effect after a restart
 void setStartHour(int value);
 void setStartMinute(int value);
 void setEndHour(int value);
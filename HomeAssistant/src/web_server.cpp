@@ -4,37 +4,51 @@
 #include "sensor_manager.h"
 #include "wifi_manager.h"
 #include "home_assistant.h"
+#include "led_controller.h"
+#include "metrics.h"
+#include "log.h"
 #include <time.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
 #include <WiFi.h>
 #include <stdio.h>
+#include <esp_heap_caps.h>
 
 // Web Server
-WebServer server(80);
+AsyncWebServer server(80);
+
+// Live sensor stream (Server-Sent Events)
+static AsyncEventSource events("/api/sensor/stream");
 
 // Smart home override flag
 volatile bool smarthomeOverride = false;
 
 // Forward declarations for HTTP handlers
-void handleRoot();
-void handleSetInterval();
-void handleSetLedOffDelay();
-void handleSetBaseColor();
-void handleSetMovingIntensity();
-void handleSetStationaryIntensity();
-void handleSetMovingLength();
-void handleSetAdditionalLEDs();
-void handleSetCenterShift();
-void handleSetTime();
-void handleSetSchedule();
-void handleNotFound();
-void handleDebugPage();
-void handleGetSensorData();
-void handleSmartHomeOn();
-void handleSmartHomeOff();
-void handleSmartHomeClear();
-void handleToggleBackgroundMode();
-void handleMqttSettings();
-void handleMqttSave();
+void handleSetInterval(AsyncWebServerRequest *request);
+void handleSetLedOffDelay(AsyncWebServerRequest *request);
+void handleSetBaseColor(AsyncWebServerRequest *request);
+void handleSetMovingIntensity(AsyncWebServerRequest *request);
+void handleSetStationaryIntensity(AsyncWebServerRequest *request);
+void handleSetMovingLength(AsyncWebServerRequest *request);
+void handleSetAdditionalLEDs(AsyncWebServerRequest *request);
+void handleSetCenterShift(AsyncWebServerRequest *request);
+void handleSetSpeedMultiplier(AsyncWebServerRequest *request);
+void handleSetNumLeds(AsyncWebServerRequest *request);
+void handleSetTime(AsyncWebServerRequest *request);
+void handleSetSchedule(AsyncWebServerRequest *request);
+void handleNotFound(AsyncWebServerRequest *request);
+void handleGetSensorData(AsyncWebServerRequest *request);
+void handleApiState(AsyncWebServerRequest *request);
+void handleApiConfig(AsyncWebServerRequest *request);
+void receiveConfigBody(AsyncWebServerRequest *request, uint8_t *data, size_t length, size_t index, size_t total);
+void handleSensorStream(AsyncEventSourceClient *client);
+void handleSensorHistory(AsyncWebServerRequest *request);
+void handleMetrics(AsyncWebServerRequest *request);
+void handleSmartHomeOn(AsyncWebServerRequest *request);
+void handleSmartHomeOff(AsyncWebServerRequest *request);
+void handleSmartHomeClear(AsyncWebServerRequest *request);
+void handleToggleBackgroundMode(AsyncWebServerRequest *request);
+void handleMqttSave(AsyncWebServerRequest *request);
 
 bool isSmartHomeOverride() {
   return smarthomeOverride;
@@ -44,9 +58,89 @@ void clearSmartHomeOverride() {
   smarthomeOverride = false;
 }
 
+// Web UI pages and files, pre-gzipped on LittleFS (built from web/ by
+// tools/build_web.py). Pages are revalidated on every load and answered with
+// 304 while unchanged; style.css and app.js are referenced with a content
+// hash in the URL, so browsers may keep them.
+struct StaticAsset {
+  const char *uri;
+  const char *path;
+  const char *contentType;
+  const char *cacheControl;
+  char etag[11];   // quoted content hash, empty when the file is missing
+};
+
+static StaticAsset assets[] = {
+  { "/",          "/index.html.gz", "text/html",              "no-cache", "" },
+  { "/debug",     "/debug.html.gz", "text/html",              "no-cache", "" },
+  { "/mqtt",      "/mqtt.html.gz",  "text/html",              "no-cache", "" },
+  { "/wifi",      "/wifi.html.gz",  "text/html",              "no-cache", "" },
+  { "/style.css", "/style.css.gz",  "text/css",               "public, max-age=31536000, immutable", "" },
+  { "/app.js",    "/app.js.gz",     "application/javascript", "public, max-age=31536000, immutable", "" },
+};
+
+// Hash each file once at startup (FNV-1a) for its ETag
+static void initStaticAssets() {
+  uint8_t buffer[256];
+  for (StaticAsset &asset : assets) {
+    asset.etag[0] = '\0';
+    File file = LittleFS.open(asset.path, "r");
+    if (!file) {
+      LOG_WARN("Web UI file %s missing; upload the filesystem image", asset.path);
+      continue;
+    }
+    uint32_t hash = 2166136261UL;
+    size_t length;
+    while ((length = file.read(buffer, sizeof(buffer))) > 0) {
+      for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ buffer[i]) * 16777619UL;
+      }
+    }
+    file.close();
+    snprintf(asset.etag, sizeof(asset.etag), "\"%08lx\"", (unsigned long)hash);
+  }
+}
+
+static void serveAsset(AsyncWebServerRequest *request, const StaticAsset &asset) {
+  if (asset.etag[0] == '\0') {
+    request->send(503, "text/plain", "Web UI not installed: upload the filesystem image (pio run -t uploadfs)");
+    return;
+  }
+
+  AsyncWebServerResponse *response;
+  if (request->header("If-None-Match") == asset.etag) {
+    response = request->beginResponse(304);
+  } else {
+    File file = LittleFS.open(asset.path, "r");
+    if (!file) {
+      request->send(503, "text/plain", "Web UI file missing");
+      return;
+    }
+    // A .gz file served under a plain name gets Content-Encoding: gzip; the
+    // file is sent a TCP window at a time and closed with the response
+    response = request->beginResponse(file, asset.uri, asset.contentType);
+  }
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control", asset.cacheControl);
+  request->send(response);
+}
+
+void sendRedirect(AsyncWebServerRequest *request, const char *location) {
+  AsyncWebServerResponse *response = request->beginResponse(303);
+  response->addHeader("Location", location);
+  request->send(response);
+}
+
 void initWebServer() {
+  initStaticAssets();
+  for (const StaticAsset &asset : assets) {
+    server.on(asset.uri, HTTP_GET, [&asset](AsyncWebServerRequest *request) { serveAsset(request, asset); });
+  }
+
   // Register HTTP handlers
-  server.on("/", handleRoot);
+  server.on("/api/state", HTTP_GET, handleApiState);
+  server.on("/api/config", HTTP_POST, handleApiConfig, NULL, receiveConfigBody);
+  server.on("/api/sensor/history", HTTP_GET, handleSensorHistory);
   server.on("/setInterval", handleSetInterval);
   server.on("/setLedOffDelay", handleSetLedOffDelay);
   server.on("/setBaseColor", handleSetBaseColor);
@@ -55,143 +149,501 @@ void initWebServer() {
   server.on("/setMovingLength", handleSetMovingLength);
   server.on("/setAdditionalLEDs", handleSetAdditionalLEDs);
   server.on("/setCenterShift", handleSetCenterShift);
+  server.on("/setSpeedMultiplier", handleSetSpeedMultiplier);
+  server.on("/setNumLeds", handleSetNumLeds);
   server.on("/setTime", handleSetTime);
   server.on("/setSchedule", handleSetSchedule);
   server.on("/smarthome/on", handleSmartHomeOn);
   server.on("/smarthome/off", handleSmartHomeOff);
   server.on("/smarthome/clear", handleSmartHomeClear);
   server.on("/toggleNightMode", handleToggleBackgroundMode);
-  server.on("/debug", handleDebugPage);
   server.on("/getSensorData", handleGetSensorData);
+  server.on("/metrics", handleMetrics);
   
   // Настройки WiFi и MQTT
-  server.on("/wifi", handleWiFiSettings);
   server.on("/savewifi", HTTP_POST, handleWiFiSave);
-  server.on("/mqtt", handleMqttSettings);
   server.on("/savemqtt", HTTP_POST, handleMqttSave);
   
   server.onNotFound(handleNotFound);
-  
+
+  events.onConnect(handleSensorStream);
+  server.addHandler(&events);
+
+  // No HTTP keep-alive: ESPAsyncWebServer closes the connection after each
+  // response and has no setting to reuse it. On the LAN the extra handshake
+  // costs far less than a request used to wait on the polled server, and the
+  // page's live data comes over the one long-lived event stream anyway.
   server.begin();
 }
 
+// ------------------------- Live sensor stream -------------------------
+
+// Server-Sent Events on /api/sensor/stream. Every STREAM_BATCH_INTERVAL the
+// samples that arrived since the last batch are formatted once and queued
+// to every viewer by the event source; a viewer whose queue is full misses
+// the batch rather than holding up the others. Each event is
+//   data: <t0>,<d0>;<dt1>,<d1>;...
+// with t0 in millis and the following times as deltas to the previous sample.
+static uint32_t streamSequence = 0;
+static unsigned long lastStreamWrite = 0;
+
+void handleSensorStream(AsyncEventSourceClient *client) {
+  if (events.count() > STREAM_MAX_CLIENTS) {
+    client->close();
+    return;
+  }
+
+  char config[40];
+  snprintf(config, sizeof(config), "{\"noise_threshold\":%d}", NOISE_THRESHOLD);
+  client->send(config, "config", 0, 2000);
+}
+
+static void flushSensorStream() {
+  if (events.count() == 0) {
+    streamSequence = 0;
+    return;
+  }
+
+  // A new viewer starts at the live edge, not with the backlog, and a stream
+  // that fell behind skips to the newest batch rather than catching up
+  uint32_t newest = getSensorSequence();
+  if (streamSequence == 0) {
+    streamSequence = newest;
+  }
+  if (newest - streamSequence > STREAM_BATCH_MAX) {
+    streamSequence = newest - STREAM_BATCH_MAX;
+  }
+
+  static SensorSample samples[STREAM_BATCH_MAX];
+  size_t count = getSensorSamples(streamSequence, samples, STREAM_BATCH_MAX);
+  unsigned long now = millis();
+  if (count == 0) {
+    // Named events the page does not listen for keep idle proxies from closing the stream
+    if (now - lastStreamWrite >= STREAM_KEEPALIVE) {
+      events.send("", "keepalive");
+      lastStreamWrite = now;
+    }
+    return;
+  }
+  streamSequence = samples[count - 1].sequence;
+
+  // Each sample takes at most 22 characters
+  static char batch[16 + STREAM_BATCH_MAX * 24];
+  size_t length = snprintf(batch, sizeof(batch), "%lu,%u",
+                           (unsigned long)samples[0].timestamp, samples[0].distance);
+  for (size_t i = 1; i < count; i++) {
+    length += snprintf(batch + length, sizeof(batch) - length, ";%lu,%u",
+                       (unsigned long)(samples[i].timestamp - samples[i - 1].timestamp), samples[i].distance);
+  }
+  events.send(batch);
+  lastStreamWrite = now;
+}
+
+// Sample history as little-endian binary, for offline tuning of the noise
+// threshold and the beam mapping. GET /api/sensor/history?since=<sequence>
+// returns every kept sample newer than since (0 for all of them):
+//
+//   header  u32 first sequence, u32 first timestamp (ms), u16 count,
+//           u16 position scale
+//   sample  u16 ms since the previous sample (0 for the first),
+//           u16 raw distance, u16 filtered position * position scale
+//
+// Sequences are consecutive from the first one; a first sequence above
+// since + 1 means older samples were already overwritten. A reply also ends
+// before a gap too long for the u16 delta, so the next one starts with an
+// absolute timestamp again. Ask again with first + count - 1 to continue.
+#define HISTORY_POSITION_SCALE 16
+#define HISTORY_HEADER_SIZE    12
+#define HISTORY_SAMPLE_SIZE    6
+
+static uint8_t *putU16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+  return out + 2;
+}
+
+static uint8_t *putU32(uint8_t *out, uint32_t value) {
+  out = putU16(out, value & 0xFFFF);
+  return putU16(out, value >> 16);
+}
+
+void handleSensorHistory(AsyncWebServerRequest *request) {
+  // Requests are handled one at a time on the AsyncTCP task and the response
+  // stream takes a copy, so one encoding buffer serves them all
+  static uint8_t body[HISTORY_HEADER_SIZE + SENSOR_HISTORY_SIZE * HISTORY_SAMPLE_SIZE];
+  uint32_t after = request->hasArg("since") ? strtoul(request->arg("since").c_str(), NULL, 10) : 0;
+
+  // Copy out a chunk at a time so the sensor task is never held up for long;
+  // stop at a gap if the ring wraps past us meanwhile
+  SensorSample chunk[16];
+  uint8_t *out = body + HISTORY_HEADER_SIZE;
+  uint32_t first = 0, firstTime = 0, lastTime = 0;
+  uint16_t count = 0;
+  bool longGap = false;
+  while (count < SENSOR_HISTORY_SIZE && !longGap) {
+    size_t n = getSensorSamples(after, chunk, min((size_t)(SENSOR_HISTORY_SIZE - count), sizeof(chunk) / sizeof(chunk[0])));
+    if (n == 0) break;
+    if (count == 0) {
+      first = chunk[0].sequence;
+      firstTime = lastTime = chunk[0].timestamp;
+    } else if (chunk[0].sequence != after + 1) {
+      break;
+    }
+    size_t used = 0;
+    for (; used < n; used++) {
+      const SensorSample &sample = chunk[used];
+      if (sample.timestamp - lastTime > 0xFFFF) {
+        longGap = true;
+        break;
+      }
+      float position = constrain(sample.position * HISTORY_POSITION_SCALE, 0.0f, 65535.0f);
+      out = putU16(out, sample.timestamp - lastTime);
+      out = putU16(out, sample.distance);
+      out = putU16(out, (uint16_t)(position + 0.5f));
+      lastTime = sample.timestamp;
+    }
+    if (used == 0) break;
+    count += used;
+    after = chunk[used - 1].sequence;
+  }
+
+  uint8_t *header = body;
+  header = putU32(header, first);
+  header = putU32(header, firstTime);
+  header = putU16(header, count);
+  putU16(header, HISTORY_POSITION_SCALE);
+
+  AsyncResponseStream *response = request->beginResponseStream("application/octet-stream", out - body);
+  response->addHeader("Cache-Control", "no-store");
+  response->write(body, out - body);
+  request->send(response);
+}
+
 void webServerTask(void * parameter) {
   for (;;) {
-    server.handleClient();
-    vTaskDelay(pdMS_TO_TICKS(10));
+    flushSensorStream();
+    vTaskDelay(pdMS_TO_TICKS(STREAM_BATCH_INTERVAL));
   }
 }
 
-// Returns a JSON with the current sensor value
-void handleGetSensorData() {
+// Returns a JSON with the current sensor value; sequence can be passed to
+// /api/sensor/history as since to fetch what follows it
+void handleGetSensorData(AsyncWebServerRequest *request) {
   String json = "{\"current\":" + String(getSensorDistance()) +
-                ",\"noise_threshold\":" + String(NOISE_THRESHOLD) + "}";
-  server.send(200, "application/json", json);
-}
-
-// Debug page with a graph (optimized for mobile portrait orientation)
-void handleDebugPage() {
-  String html = "<html><head><title>Sensor Debug</title>"
-    "<meta name='viewport' content='width=device-width, initial-scale=1, maximum-scale=1, user-scalable=no'>"
-    "<style>"
-      "body { font-family: Arial; background-color: #333; color: white; padding: 20px; margin: 0; }"
-      "canvas { background-color: #222; border: 1px solid #444; width: 100%; max-width: 320px; height: 200px; display: block; margin: auto; }"
-      ".data { font-size: 18px; margin: 10px 0; text-align: center; }"
-      "a { color: #aaaaff; text-decoration: none; }"
-    "</style>"
-    "<script>"
-      "let chart, dataPoints = [], maxDataPoints = 100;"
-      "function initChart() {"
-        "const ctx = document.getElementById('sensorChart').getContext('2d');"
-        "chart = { canvas: ctx.canvas, width: ctx.canvas.width, height: ctx.canvas.height };"
-        "setInterval(updateData, 100);"
-        "drawChart();"
-      "}"
-      "function updateData() {"
-        "fetch('/getSensorData')"
-          ".then(response => response.json())"
-          ".then(data => {"
-            "document.getElementById('currentValue').textContent = data.current;"
-            "dataPoints.push(data.current);"
-            "if (dataPoints.length > maxDataPoints) dataPoints.shift();"
-            "drawChart(data.noise_threshold);"
-          "});"
-      "}"
-      "function drawChart(noiseThreshold) {"
-        "const ctx = document.getElementById('sensorChart').getContext('2d');"
-        "ctx.clearRect(0, 0, chart.canvas.width, chart.canvas.height);"
-        "let min = Math.min(...dataPoints), max = Math.max(...dataPoints);"
-        "min = Math.max(0, min - 50);"
-        "max = max + 50;"
-        "ctx.strokeStyle = '#666';"
-        "ctx.beginPath();"
-        "ctx.moveTo(30, 10);"
-        "ctx.lineTo(30, chart.canvas.height - 20);"
-        "ctx.stroke();"
-        "ctx.beginPath();"
-        "ctx.moveTo(30, chart.canvas.height - 20);"
-        "ctx.lineTo(chart.canvas.width - 10, chart.canvas.height - 20);"
-        "ctx.stroke();"
-        "ctx.fillStyle = '#888';"
-        "ctx.font = '10px Arial';"
-        "const yStep = (chart.canvas.height - 30) / 5, valueStep = (max - min) / 5;"
-        "for (let i = 0; i <= 5; i++) {"
-          "const y = chart.canvas.height - 20 - (i * yStep);"
-          "const value = min + (i * valueStep);"
-          "ctx.fillText(Math.round(value), 5, y + 3);"
-          "ctx.strokeStyle = '#444';"
-          "ctx.beginPath();"
-          "ctx.moveTo(30, y);"
-          "ctx.lineTo(chart.canvas.width - 10, y);"
-          "ctx.stroke();"
-        "}"
-        "if (noiseThreshold) {"
-          "const y = chart.canvas.height - 20 - ((noiseThreshold - min) / (max - min) * (chart.canvas.height - 30));"
-          "ctx.strokeStyle = '#ffaa00';"
-          "ctx.beginPath();"
-          "ctx.moveTo(30, y);"
-          "ctx.lineTo(chart.canvas.width - 10, y);"
-          "ctx.stroke();"
-          "ctx.fillText('Noise', chart.canvas.width - 50, y - 5);"
-        "}"
-        "if (dataPoints.length > 1) {"
-          "const xStep = (chart.canvas.width - 40) / (maxDataPoints - 1);"
-          "ctx.strokeStyle = '#00aaff';"
-          "ctx.lineWidth = 2;"
-          "ctx.beginPath();"
-          "for (let i = 0; i < dataPoints.length; i++) {"
-            "const x = 30 + (i * xStep);"
-            "const normalizedValue = (dataPoints[i] - min) / (max - min);"
-            "const y = chart.canvas.height - 20 - (normalizedValue * (chart.canvas.height - 30));"
-            "if (i === 0) ctx.moveTo(x, y); else ctx.lineTo(x, y);"
-          "}"
-          "ctx.stroke();"
-        "}"
-      "}"
-    "</script>"
-    "</head><body onload='initChart()'>"
-      "<h1 style='text-align:center;'>Sensor Debug</h1>"
-      "<div class='data'>Current Value: <span id='currentValue'>-</span></div>"
-      "<canvas id='sensorChart'></canvas>"
-      "<p style='text-align:center;'><a href='/'>&larr; Return to main page</a></p>"
-    "</body></html>";
-  server.send(200, "text/html", html);
+                ",\"noise_threshold\":" + String(NOISE_THRESHOLD) +
+                ",\"sequence\":" + String(getSensorSequence()) + "}";
+  request->send(200, "application/json", json);
+}
+
+// Current settings and status for the web UI
+void handleApiState(AsyncWebServerRequest *request) {
+  StaticJsonDocument<1024> doc;
+  CRGB baseColor = getBaseColor();
+
+  doc["lightOn"] = isLightOn();
+  doc["backgroundMode"] = isBackgroundModeActive();
+  JsonArray color = doc.createNestedArray("baseColor");
+  color.add(baseColor.r);
+  color.add(baseColor.g);
+  color.add(baseColor.b);
+  doc["updateInterval"] = getUpdateInterval();
+  doc["ledOffDelay"] = getLedOffDelay();
+  doc["movingIntensity"] = getMovingIntensity();
+  doc["stationaryIntensity"] = getStationaryIntensity();
+  doc["movingLength"] = getMovingLength();
+  doc["centerShift"] = getCenterShift();
+  doc["additionalLEDs"] = getAdditionalLEDs();
+  doc["speedMultiplier"] = getSpeedMultiplier();
+  doc["maxSpeedMultiplier"] = MAX_SPEED_MULTIPLIER;
+
+  JsonObject schedule = doc.createNestedObject("schedule");
+  schedule["startHour"] = getStartHour();
+  schedule["startMinute"] = getStartMinute();
+  schedule["endHour"] = getEndHour();
+  schedule["endMinute"] = getEndMinute();
+
+  doc["numLeds"] = getNumLeds();
+  doc["ledCount"] = getLedCount();
+  doc["maxNumLeds"] = MAX_NUM_LEDS;
+  doc["ledMemoryUsed"] = (unsigned)getLedMemoryUsed();
+  doc["ledMemoryReserved"] = (unsigned)getLedMemoryReserved();
+
+  JsonObject wifi = doc.createNestedObject("wifi");
+  bool connected = WiFi.status() == WL_CONNECTED;
+  wifi["connected"] = connected;
+  if (connected) {
+    wifi["ssid"] = WiFi.SSID();
+    wifi["ip"] = WiFi.localIP().toString();
+  }
+
+  // The MQTT password is never sent back
+  JsonObject mqtt = doc.createNestedObject("mqtt");
+  mqtt["server"] = getMqttServer();
+  mqtt["port"] = getMqttPort();
+  mqtt["user"] = getMqttUser();
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json", measureJson(doc));
+  serializeJson(doc, *response);
+  request->send(response);
+}
+
+// ------------------------- Batched configuration -------------------------
+
+// JSON names of the settings accepted by /api/config, as in /api/state
+struct ConfigField {
+  uint32_t field;
+  const char *name;
+};
+
+static const ConfigField configFields[] = {
+  { SETTING_UPDATE_INTERVAL,      "updateInterval" },
+  { SETTING_LED_OFF_DELAY,        "ledOffDelay" },
+  { SETTING_MOVING_INTENSITY,     "movingIntensity" },
+  { SETTING_STATIONARY_INTENSITY, "stationaryIntensity" },
+  { SETTING_MOVING_LENGTH,        "movingLength" },
+  { SETTING_CENTER_SHIFT,         "centerShift" },
+  { SETTING_ADDITIONAL_LEDS,      "additionalLEDs" },
+  { SETTING_BASE_COLOR,           "baseColor" },
+  { SETTING_SPEED_MULTIPLIER,     "speedMultiplier" },
+  { SETTING_NUM_LEDS,             "numLeds" },
+  { SETTING_SCHEDULE,             "schedule" },
+  { SETTING_BACKGROUND_MODE,      "backgroundMode" },
+};
+
+static void sendConfigError(AsyncWebServerRequest *request, const char *error, const char *field) {
+  StaticJsonDocument<128> doc;
+  doc["error"] = error;
+  doc["field"] = field;
+  String json;
+  serializeJson(doc, json);
+  request->send(400, "application/json", json);
+}
+
+// Read one field into the update; false if its JSON type is wrong
+static bool readConfigField(uint32_t field, JsonVariant value, SettingsUpdate &update) {
+  switch (field) {
+    case SETTING_UPDATE_INTERVAL:
+      update.updateInterval = value;
+      return value.is<int>();
+    case SETTING_LED_OFF_DELAY:
+      update.ledOffDelay = value;
+      return value.is<int>();
+    case SETTING_MOVING_INTENSITY:
+      update.movingIntensity = value;
+      return value.is<float>();
+    case SETTING_STATIONARY_INTENSITY:
+      update.stationaryIntensity = value;
+      return value.is<float>();
+    case SETTING_MOVING_LENGTH:
+      update.movingLength = value;
+      return value.is<int>();
+    case SETTING_CENTER_SHIFT:
+      update.centerShift = value;
+      return value.is<int>();
+    case SETTING_ADDITIONAL_LEDS:
+      update.additionalLEDs = value;
+      return value.is<int>();
+    case SETTING_BASE_COLOR: {
+      // [r, g, b]
+      JsonArray color = value;
+      if (color.isNull() || color.size() != 3) return false;
+      for (size_t i = 0; i < 3; i++) {
+        if (!color[i].is<uint8_t>()) return false;
+        update.baseColor[i] = color[i];
+      }
+      return true;
+    }
+    case SETTING_SPEED_MULTIPLIER:
+      update.speedMultiplier = value;
+      return value.is<float>();
+    case SETTING_NUM_LEDS:
+      update.numLeds = value;
+      return value.is<int>();
+    case SETTING_SCHEDULE: {
+      // All four times, so start and end always change together
+      JsonObject schedule = value;
+      if (schedule.isNull() ||
+          !schedule["startHour"].is<int>() || !schedule["startMinute"].is<int>() ||
+          !schedule["endHour"].is<int>() || !schedule["endMinute"].is<int>()) return false;
+      update.startHour = schedule["startHour"];
+      update.startMinute = schedule["startMinute"];
+      update.endHour = schedule["endHour"];
+      update.endMinute = schedule["endMinute"];
+      return true;
+    }
+    case SETTING_BACKGROUND_MODE:
+      update.backgroundMode = value;
+      return value.is<bool>();
+  }
+  return false;
+}
+
+// The body arrives in pieces before the request handler runs; it is kept in
+// the request's scratch pointer, which the server frees with the request
+void receiveConfigBody(AsyncWebServerRequest *request, uint8_t *data, size_t length, size_t index, size_t total) {
+  if (total > CONFIG_MAX_BODY) return;
+  if (index == 0) {
+    request->_tempObject = calloc(total + 1, 1);
+  }
+  if (request->_tempObject != NULL) {
+    memcpy((char *)request->_tempObject + index, data, length);
+  }
+}
+
+// POST /api/config with a JSON object holding any subset of the settings in
+// /api/state. Either every field is valid and all of them are applied
+// together (and saved in one write), answered with the new state, or nothing
+// changes and the first bad field is reported with a 400.
+void handleApiConfig(AsyncWebServerRequest *request) {
+  // Parsed in place: keys and strings point into the body
+  char *body = (char *)request->_tempObject;
+  if (body == NULL) {
+    sendConfigError(request, "body missing or too large", "");
+    return;
+  }
+
+  StaticJsonDocument<512> doc;
+  DeserializationError error = deserializeJson(doc, body);
+  if (error || !doc.is<JsonObject>()) {
+    sendConfigError(request, "invalid JSON", "");
+    return;
+  }
+
+  SettingsUpdate update = {};
+  for (JsonPair pair : doc.as<JsonObject>()) {
+    const ConfigField *match = NULL;
+    for (const ConfigField &config : configFields) {
+      if (strcmp(pair.key().c_str(), config.name) == 0) {
+        match = &config;
+        break;
+      }
+    }
+    if (match == NULL) {
+      sendConfigError(request, "unknown field", pair.key().c_str());
+      return;
+    }
+    if (!readConfigField(match->field, pair.value(), update)) {
+      sendConfigError(request, "wrong type", match->name);
+      return;
+    }
+    update.fields |= match->field;
+  }
+
+  uint32_t invalid = validateSettings(update);
+  if (invalid != 0) {
+    for (const ConfigField &config : configFields) {
+      if (config.field == invalid) sendConfigError(request, "out of range", config.name);
+    }
+    return;
+  }
+
+  applySettings(update);
+  handleApiState(request);
+}
+
+// ------------------------- Prometheus metrics -------------------------
+
+static void addMetric(Print &out, const char *name, const char *type, const char *help) {
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void addSample(Print &out, const char *name, const char *labels, double value) {
+  out.printf("%s%s %.10g\n", name, labels, value);
+}
+
+static void addValue(Print &out, const char *name, const char *type, const char *help, double value) {
+  addMetric(out, name, type, help);
+  addSample(out, name, "", value);
+}
+
+// Buckets are exported cumulative and in seconds. _count is taken from the
+// +Inf bucket so the two agree even while the LED task keeps updating.
+static void addHistogram(Print &out, const char *name, const char *help, const Histogram &histogram) {
+  char series[64];
+  char labels[24];
+  addMetric(out, name, "histogram", help);
+
+  snprintf(series, sizeof(series), "%s_bucket", name);
+  uint32_t cumulative = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+    snprintf(labels, sizeof(labels), "{le=\"%g\"}", histogramBounds[i] / 1e6);
+    addSample(out, series, labels, cumulative);
+  }
+  cumulative += histogram.buckets[HISTOGRAM_BUCKETS].load(std::memory_order_relaxed);
+  addSample(out, series, "{le=\"+Inf\"}", cumulative);
+
+  snprintf(series, sizeof(series), "%s_sum", name);
+  addSample(out, series, "", histogram.sum.load(std::memory_order_relaxed) / 1e6);
+  snprintf(series, sizeof(series), "%s_count", name);
+  addSample(out, series, "", cumulative);
+}
+
+void handleMetrics(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4", 4096);
+  Print &out = *response;
+
+  addValue(out, "lighttrack_uptime_seconds", "gauge", "Time since boot", millis() / 1000.0);
+
+  // LED task
+  FrameStats frames = getFrameStats();
+  addHistogram(out, "lighttrack_frame_render_seconds", "Time to render one frame", getRenderTimeHistogram());
+  addHistogram(out, "lighttrack_frame_show_seconds", "Time to push one frame to the strip", getShowTimeHistogram());
+  addValue(out, "lighttrack_frames_rendered_total", "counter", "Frames evaluated by the LED task", frames.framesRendered);
+  addValue(out, "lighttrack_frames_shown_total", "counter", "Frames pushed to the strip", frames.framesShown);
+  addValue(out, "lighttrack_frame_deadlines_missed_total", "counter", "Fixed-cadence frames that started late", frames.missedDeadlines);
+
+  // Sensor
+  SensorStats sensor = getSensorStats();
+  addValue(out, "lighttrack_sensor_frames_total", "counter", "Valid sensor frames received", sensor.goodFrames);
+  addMetric(out, "lighttrack_sensor_errors_total", "counter", "Sensor frames rejected or lost, by cause");
+  addSample(out, "lighttrack_sensor_errors_total", "{type=\"checksum\"}", sensor.checksumErrors);
+  addSample(out, "lighttrack_sensor_errors_total", "{type=\"resync\"}", sensor.resyncs);
+  addSample(out, "lighttrack_sensor_errors_total", "{type=\"out_of_range\"}", sensor.outOfRange);
+
+  // MQTT
+  MqttStats mqtt = getMqttStats();
+  addValue(out, "lighttrack_mqtt_connected", "gauge", "1 while connected to the MQTT broker", mqtt.connected ? 1 : 0);
+  addValue(out, "lighttrack_mqtt_connects_total", "counter", "Successful MQTT (re)connects", mqtt.connects);
+  addValue(out, "lighttrack_mqtt_connect_failures_total", "counter", "Failed MQTT connection attempts", mqtt.connectFailures);
+  addValue(out, "lighttrack_mqtt_publish_failures_total", "counter", "MQTT messages that could not be sent", mqtt.publishFailures);
+
+  // Storage and logging
+  StorageStats storage = getStorageStats();
+  addValue(out, "lighttrack_flash_commits_total", "counter", "Settings records written to flash", storage.commits);
+  addValue(out, "lighttrack_flash_commit_failures_total", "counter", "Failed settings record writes", storage.commitFailures);
+  addValue(out, "lighttrack_log_dropped_total", "counter", "Log messages dropped with the log buffer full", getLogDropped());
+
+  // Tasks and heap
+  addMetric(out, "lighttrack_task_stack_free_min_bytes", "gauge", "Smallest amount of stack a task has had left");
+  for (int i = 0; i < getTaskMetricsCount(); i++) {
+    TaskMetrics task = getTaskMetrics(i);
+    char labels[32];
+    snprintf(labels, sizeof(labels), "{task=\"%s\"}", task.name);
+    addSample(out, "lighttrack_task_stack_free_min_bytes", labels, uxTaskGetStackHighWaterMark(task.handle));
+  }
+  addValue(out, "lighttrack_heap_free_bytes", "gauge", "Free heap", ESP.getFreeHeap());
+  addValue(out, "lighttrack_heap_min_free_bytes", "gauge", "Lowest free heap since boot", ESP.getMinFreeHeap());
+  addValue(out, "lighttrack_heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block",
+           heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+  request->send(response);
 }
 
 // Smart Home Integration Endpoints
-void handleSmartHomeOn() {
+void handleSmartHomeOn(AsyncWebServerRequest *request) {
   setLightOn(true);
   smarthomeOverride = true;
-  server.send(200, "text/plain", "Smart Home Override: ON");
+  request->send(200, "text/plain", "Smart Home Override: ON");
 }
 
-void handleSmartHomeOff() {
+void handleSmartHomeOff(AsyncWebServerRequest *request) {
   setLightOn(false);
   smarthomeOverride = true;
-  server.send(200, "text/plain", "Smart Home Override: OFF");
+  request->send(200, "text/plain", "Smart Home Override: OFF");
 }
 
-void handleSmartHomeClear() {
+void handleSmartHomeClear(AsyncWebServerRequest *request) {
   smarthomeOverride = false;
   time_t nowSec = time(nullptr);
   if (nowSec < 1000000000UL)
@@ -208,22 +660,21 @@ void handleSmartHomeClear() {
         setLightOn(currentTotal >= startTotal || currentTotal < endTotal);
     }
   }
-  server.send(200, "text/plain", "Smart Home Override: CLEARED");
+  request->send(200, "text/plain", "Smart Home Override: CLEARED");
 }
 
 // Toggle Background Light Mode Handler
-void handleToggleBackgroundMode() {
+void handleToggleBackgroundMode(AsyncWebServerRequest *request) {
   toggleBackgroundMode();
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
 // Time Functions
-void handleSetTime() {
-  if (server.hasArg("epoch")) {
-    unsigned long epoch = server.arg("epoch").toInt();
-    if (server.hasArg("tz")) {
-      int tz = server.arg("tz").toInt();
+void handleSetTime(AsyncWebServerRequest *request) {
+  if (request->hasArg("epoch")) {
+    unsigned long epoch = request->arg("epoch").toInt();
+    if (request->hasArg("tz")) {
+      int tz = request->arg("tz").toInt();
       epoch += tz * 60;
     }
     if (epoch > 1000000000UL) {
@@ -243,252 +694,115 @@ void handleSetTime() {
       }
     }
   }
-  server.send(200, "text/plain", "OK");
+  request->send(200, "text/plain", "OK");
 }
 
-void handleSetSchedule() {
-  if (server.hasArg("startHour") && server.hasArg("startMinute") &&
-      server.hasArg("endHour") && server.hasArg("endMinute")) {
-    setStartHour(server.arg("startHour").toInt());
-    setStartMinute(server.arg("startMinute").toInt());
-    setEndHour(server.arg("endHour").toInt());
-    setEndMinute(server.arg("endMinute").toInt());
+void handleSetSchedule(AsyncWebServerRequest *request) {
+  if (request->hasArg("startHour") && request->hasArg("startMinute") &&
+      request->hasArg("endHour") && request->hasArg("endMinute")) {
+    setStartHour(request->arg("startHour").toInt());
+    setStartMinute(request->arg("startMinute").toInt());
+    setEndHour(request->arg("endHour").toInt());
+    setEndMinute(request->arg("endMinute").toInt());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleNotFound() {
-  server.send(404, "text/plain", "Not Found");
+void handleNotFound(AsyncWebServerRequest *request) {
+  request->send(404, "text/plain", "Not Found");
 }
 
-void handleSetInterval() {
-  if (server.hasArg("value")) {
-    setUpdateInterval(server.arg("value").toInt());
+void handleSetInterval(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setUpdateInterval(request->arg("value").toInt());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleSetLedOffDelay() {
-  if (server.hasArg("value")) {
-    setLedOffDelay(server.arg("value").toInt());
+void handleSetLedOffDelay(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setLedOffDelay(request->arg("value").toInt());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleSetBaseColor() {
-  if (server.hasArg("r") && server.hasArg("g") && server.hasArg("b")) {
+void handleSetBaseColor(AsyncWebServerRequest *request) {
+  if (request->hasArg("r") && request->hasArg("g") && request->hasArg("b")) {
     CRGB color = CRGB(
-      server.arg("r").toInt(),
-      server.arg("g").toInt(),
-      server.arg("b").toInt()
+      request->arg("r").toInt(),
+      request->arg("g").toInt(),
+      request->arg("b").toInt()
     );
     setBaseColor(color);
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleSetMovingIntensity() {
-  if (server.hasArg("value")) {
-    setMovingIntensity(server.arg("value").toFloat());
+void handleSetMovingIntensity(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setMovingIntensity(request->arg("value").toFloat());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleSetStationaryIntensity() {
-  if (server.hasArg("value")) {
-    setStationaryIntensity(server.arg("value").toFloat());
+void handleSetStationaryIntensity(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setStationaryIntensity(request->arg("value").toFloat());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleSetMovingLength() {
-  if (server.hasArg("value")) {
-    setMovingLength(server.arg("value").toInt());
+void handleSetMovingLength(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setMovingLength(request->arg("value").toInt());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleSetAdditionalLEDs() {
-  if (server.hasArg("value")) {
-    setAdditionalLEDs(server.arg("value").toInt());
+void handleSetAdditionalLEDs(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setAdditionalLEDs(request->arg("value").toInt());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-void handleSetCenterShift() {
-  if (server.hasArg("value")) {
-    setCenterShift(server.arg("value").toInt());
+void handleSetCenterShift(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setCenterShift(request->arg("value").toInt());
   }
-  server.sendHeader("Location", "/");
-  server.send(303);
+  sendRedirect(request, "/");
 }
 
-// Web Interface Handler
-void handleRoot() {
-  char scheduleStartStr[6];
-  sprintf(scheduleStartStr, "%02d:%02d", getStartHour(), getStartMinute());
-  
-  char scheduleEndStr[6];
-  sprintf(scheduleEndStr, "%02d:%02d", getEndHour(), getEndMinute());
+void handleSetSpeedMultiplier(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setSpeedMultiplier(request->arg("value").toFloat());
+  }
+  sendRedirect(request, "/");
+}
 
-  CRGB baseColor = getBaseColor();
-  
-  String html = "<html><head><title>LED Control</title>"
-    "<meta name='viewport' content='width=device-width, initial-scale=1, maximum-scale=1, user-scalable=no'>"
-    "<style>"
-      "body { margin: 0; padding: 0; background-color: #333; color: white; font-family: Arial, sans-serif; }"
-      ".container { text-align: center; width: 90%; max-width: 800px; margin: auto; padding-top: 20px; }"
-      ".lighttrack { font-size: 1.4em; }"
-      ".footer { font-size: 1em; margin-top: 20px; }"
-      "input[type=range] { -webkit-appearance: none; width: 100%; height: 25px; background: transparent; }"
-      "input[type=range]:focus { outline: none; }"
-      "input[type=range]::-webkit-slider-runnable-track { height: 8px; background: #F5F5DC; border-radius: 4px; }"
-      "input[type=range]::-webkit-slider-thumb { -webkit-appearance: none; height: 25px; width: 25px; background: #fff; border: 2px solid #ccc; border-radius: 50%; margin-top: -9px; }"
-      "input[type=range]::-moz-range-track { height: 8px; background: #F5F5DC; border-radius: 4px; }"
-      "input[type=range]::-moz-range-thumb { height: 25px; width: 25px; background: #fff; border: 2px solid #ccc; border-radius: 50%; }"
-      "input[type=color] { width: 100px; height: 100px; border: none; }"
-      "input[type=time] { font-size: 1.2em; margin: 5px; }"
-      "button { font-size: 1em; margin: 5px; padding: 10px; }"
-      ".nav-links { margin: 20px 0; }"
-      ".nav-links a { display: inline-block; margin: 0 10px; color: #aaaaff; text-decoration: none; }"
-    "</style>"
-    "<script>"
-      "function setDeviceTime() { " 
-        "var now = new Date(); " 
-        "var epoch = Math.floor(now.getTime()/1000); " 
-        "var tz = -now.getTimezoneOffset(); " 
-        "fetch('/setTime?epoch='+epoch+'&tz='+tz); " 
-      "}"
-      "function changeBaseColor(hex) { "
-        "var r = parseInt(hex.substring(1,3),16); "
-        "var g = parseInt(hex.substring(3,5),16); "
-        "var b = parseInt(hex.substring(5,7),16); "
-        "fetch('/setBaseColor?r=' + r + '&g=' + g + '&b=' + b);"
-      "}"
-      "function setMovingIntensity(val) { fetch('/setMovingIntensity?value=' + val); }"
-      "function setMovingLength(val) { fetch('/setMovingLength?value=' + val); }"
-      "function setAdditionalLEDs(val) { fetch('/setAdditionalLEDs?value=' + val); }"
-      "function setCenterShift(val) { fetch('/setCenterShift?value=' + val); }"
-      "function setIntervalVal(val) { fetch('/setInterval?value=' + val); }"
-      "function setLedOffDelay(val) { fetch('/setLedOffDelay?value=' + val); }"
-      "function setSchedule(startTime, endTime) { "
-         "var sParts = startTime.split(':'); "
-         "var eParts = endTime.split(':'); "
-         "fetch('/setSchedule?startHour=' + sParts[0] + '&startMinute=' + sParts[1] + "
-              "'&endHour=' + eParts[0] + '&endMinute=' + eParts[1]); "
-      "}"
-      "function setStationaryIntensityValue(val) { fetch('/setStationaryIntensity?value=' + val * 0.01); }"
-      "function toggleBackgroundMode() {"
-         "fetch('/toggleNightMode').then(()=>location.reload());"
-      "}"
-    "</script>"
-    "</head><body onload='setDeviceTime()'>"
-    "<div class='container'>"
-      "<h1 class='lighttrack'>LED Control Panel</h1>"
-      "<div style='display: flex; justify-content: center; margin-bottom:10px;'>"
-        "<input type='color' id='baseColorPicker' value='#" 
-          + String((baseColor.r < 16 ? "0" : "") + String(baseColor.r, HEX))
-          + String((baseColor.g < 16 ? "0" : "") + String(baseColor.g, HEX))
-          + String((baseColor.b < 16 ? "0" : "") + String(baseColor.b, HEX))
-          + "' onchange='changeBaseColor(this.value)'>"
-      "</div>"
-      "<p>Moving Light Intensity: <span id='movingIntensityValue'>" + String(getMovingIntensity()) + "</span></p>"
-      "<input type='range' min='0' max='1' step='0.01' value='" + String(getMovingIntensity()) + "' oninput='document.getElementById(\"movingIntensityValue\").innerText = this.value' onchange='setMovingIntensity(this.value)'>"
-      "<p>Moving Light Length: <span id='movingLengthValue'>" + String(getMovingLength()) + "</span></p>"
-      "<input type='range' min='1' max='300' step='1' value='" + String(getMovingLength()) + "' oninput='document.getElementById(\"movingLengthValue\").innerText = this.value' onchange='setMovingLength(this.value)'>"
-      "<p>Additional LEDs (direction): <span id='additionalLEDsValue'>" + String(getAdditionalLEDs()) + "</span></p>"
-      "<input type='range' min='0' max='100' step='1' value='" + String(getAdditionalLEDs()) + "' oninput='document.getElementById(\"additionalLEDsValue\").innerText = this.value' onchange='setAdditionalLEDs(this.value)'>"
-      "<p>Center Shift (LEDs): <span id='centerShiftValue'>" + String(getCenterShift()) + "</span></p>"
-      "<input type='range' min='-100' max='100' step='1' value='" + String(getCenterShift()) + "' oninput='document.getElementById(\"centerShiftValue\").innerText = this.value' onchange='setCenterShift(this.value)'>"
-      "<p>LED Off Delay (seconds): <span id='ledOffDelayValue'>" + String(getLedOffDelay()) + "</span></p>"
-      "<input type='range' min='1' max='60' step='1' value='" + String(getLedOffDelay()) + "' oninput='document.getElementById(\"ledOffDelayValue\").innerText = this.value' onchange='setLedOffDelay(this.value)'>"
-      "<p>Background Light Mode:</p>"
-      "<button onclick='toggleBackgroundMode()'>" + String(isBackgroundModeActive() ? "Disable" : "Enable") + " Background Light</button>"
-      "<p>LED Light Intensity: <span id='stationaryIntensityValue'>" + String(getStationaryIntensity() * 100) + "</span></p>"
-      "<input type='range' min='0' max='7' step='0.01' value='" + String(getStationaryIntensity() * 100) + "' oninput='document.getElementById(\"stationaryIntensityValue\").innerText = this.value' onchange='setStationaryIntensityValue(this.value)'>"
-      "<hr style='border: none; height: 2px; background: #fff; margin: 20px 0;'>"
-      "<p>Schedule Window (From - To):</p>"
-      "<div style='display: flex; justify-content: center; gap: 15px;'>"
-        "<input type='time' id='scheduleStartInput' value='" + String(scheduleStartStr) + "' onchange='setSchedule(this.value, document.getElementById(\"scheduleEndInput\").value)'>"
-        "<input type='time' id='scheduleEndInput' value='" + String(scheduleEndStr) + "' onchange='setSchedule(document.getElementById(\"scheduleStartInput\").value, this.value)'>"
-      "</div>"
-      "<div class='nav-links'>"
-        "<a href='/debug'>Sensor Debug</a> | "
-        "<a href='/wifi'>WiFi Settings</a> | "
-        "<a href='/mqtt'>MQTT Settings</a>"
-      "</div>";
-      
-  // Show connection status if connected to WiFi
-  if (WiFi.status() == WL_CONNECTED) {
-    html += "<p>WiFi: Connected to " + WiFi.SSID() + " (" + WiFi.localIP().toString() + ")</p>";
-  }
-      
-  html += "<div class='footer'>DIY Yari</div>"
-    "</div></body></html>";
-  
-  server.send(200, "text/html", html);
-}
-
-// MQTT Settings Page
-void handleMqttSettings() {
-  String html = "<html><head><title>MQTT Settings</title>"
-    "<meta name='viewport' content='width=device-width, initial-scale=1, maximum-scale=1, user-scalable=no'>"
-    "<style>"
-      "body { margin: 0; padding: 0; background-color: #333; color: white; font-family: Arial, sans-serif; }"
-      ".container { text-align: center; width: 90%; max-width: 800px; margin: auto; padding-top: 20px; }"
-      "input[type=text], input[type=password], input[type=number] { width: 80%; padding: 8px; margin: 5px; }"
-      "input[type=submit] { padding: 10px 20px; margin: 15px; background-color: #4CAF50; color: white; border: none; cursor: pointer; }"
-      "a { color: #aaaaff; text-decoration: none; }"
-      ".note { color: #ffcc00; background-color: #333333; border: 1px solid #ffcc00; padding: 10px; margin: 15px 0; border-radius: 5px; }"
-    "</style>"
-    "</head><body>"
-    "<div class='container'>"
-      "<h1>MQTT Settings</h1>"
-      "<div class='note'>"
-        "<p>Устройство работает только в режиме точки доступа.</p>"
-        "<p>Для подключения к MQTT-брокеру введите его IP-адрес.</p>"
-        "<p>Важно: IP-адрес должен быть доступен напрямую из сети устройства.</p>"
-      "</div>"
-      "<form action='/savemqtt' method='post'>"
-        "<p>MQTT Server:</p>"
-        "<input type='text' name='server' value='" + getMqttServer() + "'>"
-        "<p>Port:</p>"
-        "<input type='number' name='port' value='" + String(getMqttPort()) + "'>"
-        "<p>Username (if needed):</p>"
-        "<input type='text' name='user' value='" + getMqttUser() + "'>"
-        "<p>Password (if needed):</p>"
-        "<input type='password' name='password' value='" + getMqttPassword() + "'>"
-        "<br>"
-        "<input type='submit' value='Save'>"
-      "</form>"
-      "<p><a href='/'>Back to main page</a></p>"
-    "</div></body></html>";
-  
-  server.send(200, "text/html", html);
+void handleSetNumLeds(AsyncWebServerRequest *request) {
+  if (request->hasArg("value")) {
+    setNumLeds(request->arg("value").toInt());
+  }
+  sendRedirect(request, "/");
 }
 
 // MQTT Save Handler
-void handleMqttSave() {
-  if (server.hasArg("server")) {
-    String mqttServer = server.arg("server");
-    int mqttPort = server.hasArg("port") ? server.arg("port").toInt() : 1883;
-    String mqttUser = server.hasArg("user") ? server.arg("user") : "";
-    String mqttPassword = server.hasArg("password") ? server.arg("password") : "";
+void handleMqttSave(AsyncWebServerRequest *request) {
+  if (request->hasArg("server")) {
+    String mqttServer = request->arg("server");
+    int mqttPort = request->hasArg("port") ? request->arg("port").toInt() : 1883;
+    String mqttUser = request->hasArg("user") ? request->arg("user") : "";
+    // The page never shows the stored password; an empty field keeps it
+    String mqttPassword = request->hasArg("password") && request->arg("password").length() > 0 ?
+                          request->arg("password") : getMqttPassword();
     
     saveMqttSettings(mqttServer.c_str(), mqttPort, mqttUser.c_str(), mqttPassword.c_str());
     
-    // Connect to MQTT with new settings
-    setMqttServer(mqttServer);
+    // Connect to MQTT with new settings, from the loop task: connecting
+    // blocks, and the client is not safe to use from this task
+    requestMqttReconnect();
   }
   
-  server.sendHeader("Location", "/mqtt");
-  server.send(303);
+  sendRedirect(request, "/mqtt");
 }
\ No newline at end of file
@@ -2,23 +2,25 @@
 #define WEB_SERVER_H
 
 #include <Arduino.h>
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
 
 // Сервер для использования в других модулях
-extern WebServer server;
+extern AsyncWebServer server;
 
-// Initialize web server
+// Initialize web server; requests are then answered from the AsyncTCP task
 void initWebServer();
 
-// Web server task function
+// Pushes new sensor samples to the live stream viewers
 void webServerTask(void * parameter);
 
+// Answer with 303 See Other, as the settings forms expect
+void sendRedirect(AsyncWebServerRequest *request, const char *location);
+
 // Smart home controls
 bool isSmartHomeOverride();
 void clearSmartHomeOverride();
 
-// MQTT settings handlers
-void handleMqttSettings();
-void handleMqttSave();
+// MQTT settings form handler
+void handleMqttSave(AsyncWebServerRequest *request);
 
 #endif // WEB_SERVER_H
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define WIFI_MANAGER_H
 
 #include <Arduino.h>
+#include <ESPAsyncWebServer.h>
 
 // Setup WiFi
 void setupWiFi();
@@ -9,7 +10,6 @@ void setupWiFi();
 // Get the device name (SSID)
 String getDeviceName();
 
-void handleWiFiSettings();
-void handleWiFiSave();
+void handleWiFiSave(AsyncWebServerRequest *request);
 
 #endif // WIFI_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,234 @@
+// Frame compositor: recomposing only the damaged pixels has to give the same
+// frame as drawing every layer from scratch, with spans clipped at both strip
+// ends and blended layers crossing the scratch chunk boundaries.
+//   pio test -e native -f test_compositor
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <unity.h>
+
+#include "compositor.h"
+#include "config.h"
+
+// Not a multiple of COMPOSITOR_CHUNK, so the last chunk is a short one
+#define STRIP_LENGTH  150
+
+static CRGB frame[STRIP_LENGTH];
+static CRGB expected[STRIP_LENGTH];
+
+// Pixels each layer was asked to render since the last resetCounts()
+static int renderedPixels[COMPOSITOR_MAX_LAYERS];
+static bool renderOutsideSpan;
+static bool renderOverChunk;
+
+// Every layer draws a fixed pattern by strip position, seeded by its index,
+// so any pixel can be recomputed on its own
+static CRGB patternAt(int layer, int position) {
+  return CRGB((uint8_t)(position * 7 + layer * 61),
+              (uint8_t)(position * 13 + layer * 17 + 40),
+              (uint8_t)(255 - position * 3 - layer * 29));
+}
+
+static void renderPattern(const Layer &layer, CRGB *out, int start, int count) {
+  int index = (int)(intptr_t)layer.context;
+  renderedPixels[index] += count;
+  if (start < layer.span.start || start + count > layer.span.start + layer.span.length ||
+      start < 0 || start + count > STRIP_LENGTH) {
+    renderOutsideSpan = true;
+  }
+  if (layer.blend != BLEND_REPLACE && count > COMPOSITOR_CHUNK) {
+    renderOverChunk = true;
+  }
+  for (int i = 0; i < count; i++) {
+    out[i] = patternAt(index, start + i);
+  }
+}
+
+static Layer layers[4];
+static int layerCount;
+
+static Layer &makeLayer(BlendMode blend) {
+  Layer &layer = layers[layerCount];
+  layer = { "test", blend, renderPattern, (void *)(intptr_t)layerCount, false, { 0, 0 }, false, false, { 0, 0 } };
+  layerCount++;
+  TEST_ASSERT_TRUE(addLayer(layer));
+  return layer;
+}
+
+// Every visible layer blended pixel by pixel over a black frame, bottom to top
+static void drawReference() {
+  for (int p = 0; p < STRIP_LENGTH; p++) {
+    CRGB pixel = CRGB::Black;
+    for (int i = 0; i < layerCount; i++) {
+      const Layer &layer = layers[i];
+      if (!layer.visible || p < layer.span.start || p >= layer.span.start + layer.span.length) continue;
+      CRGB color = patternAt(i, p);
+      switch (layer.blend) {
+        case BLEND_REPLACE: pixel = color; break;
+        case BLEND_ADD:     pixel += color; break;
+        case BLEND_MAX:
+          pixel = CRGB(max(pixel.r, color.r), max(pixel.g, color.g), max(pixel.b, color.b));
+          break;
+      }
+    }
+    expected[p] = pixel;
+  }
+}
+
+static void checkFrame() {
+  drawReference();
+  for (int p = 0; p < STRIP_LENGTH; p++) {
+    char message[32];
+    snprintf(message, sizeof(message), "pixel %d", p);
+    TEST_ASSERT_EQUAL_HEX32_MESSAGE(((uint32_t)expected[p].r << 16) | (expected[p].g << 8) | expected[p].b,
+                                    ((uint32_t)frame[p].r << 16) | (frame[p].g << 8) | frame[p].b,
+                                    message);
+  }
+  TEST_ASSERT_FALSE(renderOutsideSpan);
+  TEST_ASSERT_FALSE(renderOverChunk);
+}
+
+static void resetCounts() {
+  memset(renderedPixels, 0, sizeof(renderedPixels));
+}
+
+void setUp() {
+  // Stale pixels from an earlier test must not survive the first full redraw
+  fill_solid(frame, STRIP_LENGTH, CRGB(1, 2, 3));
+  initCompositor(frame, STRIP_LENGTH);
+  layerCount = 0;
+  renderOutsideSpan = false;
+  renderOverChunk = false;
+  resetCounts();
+}
+
+void tearDown() {}
+
+static void test_spans_are_clipped_at_both_ends() {
+  Layer &layer = makeLayer(BLEND_REPLACE);
+
+  placeLayer(layer, true, { -10, 25 });
+  TEST_ASSERT_EQUAL_INT(0, layer.span.start);
+  TEST_ASSERT_EQUAL_INT(15, layer.span.length);
+  composeFrame();
+  checkFrame();
+
+  placeLayer(layer, true, { STRIP_LENGTH - 5, 25 });
+  TEST_ASSERT_EQUAL_INT(STRIP_LENGTH - 5, layer.span.start);
+  TEST_ASSERT_EQUAL_INT(5, layer.span.length);
+  composeFrame();
+  checkFrame();
+
+  // Nothing left on the strip: hidden, and the old pixels are cleared
+  placeLayer(layer, true, { STRIP_LENGTH + 3, 10 });
+  TEST_ASSERT_FALSE(layer.visible);
+  TEST_ASSERT_TRUE(composeFrame());
+  checkFrame();
+
+  placeLayer(layer, true, { -40, 30 });
+  TEST_ASSERT_FALSE(layer.visible);
+  TEST_ASSERT_FALSE(composeFrame());
+  checkFrame();
+}
+
+// A blended span crossing chunk boundaries is rendered a chunk at a time
+// through the scratch buffer and has to match a per-pixel blend
+static void test_blending_across_chunk_boundaries() {
+  Layer &base = makeLayer(BLEND_REPLACE);
+  Layer &add = makeLayer(BLEND_ADD);
+  Layer &top = makeLayer(BLEND_MAX);
+
+  placeLayer(base, true, { 0, STRIP_LENGTH });
+  placeLayer(add, true, { COMPOSITOR_CHUNK - 3, 2 * COMPOSITOR_CHUNK + 6 });
+  placeLayer(top, true, { 2 * COMPOSITOR_CHUNK - 1, 2 });
+  composeFrame();
+  checkFrame();
+
+  // Ends exactly on a boundary, and one past the last full chunk
+  placeLayer(add, true, { COMPOSITOR_CHUNK, COMPOSITOR_CHUNK });
+  placeLayer(top, true, { 4 * COMPOSITOR_CHUNK - 1, STRIP_LENGTH });
+  composeFrame();
+  checkFrame();
+
+  // The blended layer with nothing below it adds onto black
+  placeLayer(base, false, { 0, 0 });
+  composeFrame();
+  checkFrame();
+}
+
+// Damage from several layers arrives out of order and overlapping; each
+// merged range is redrawn once, so no pixel is rendered twice
+static void test_overlapping_damage_is_merged() {
+  Layer &base = makeLayer(BLEND_REPLACE);
+  Layer &a = makeLayer(BLEND_ADD);
+  Layer &b = makeLayer(BLEND_REPLACE);
+  Layer &c = makeLayer(BLEND_MAX);
+
+  placeLayer(base, true, { 0, STRIP_LENGTH });
+  placeLayer(a, true, { 100, 20 });
+  placeLayer(b, true, { 60, 10 });
+  placeLayer(c, true, { 5, 10 });
+  composeFrame();
+  checkFrame();
+  TEST_ASSERT_EQUAL_INT(STRIP_LENGTH, renderedPixels[0]);
+
+  // Damage: a [100,120) + [10,30), b [60,70) + [25,45), c [5,15) + [110,125).
+  // Merged: [5,45), [60,70), [100,125)
+  resetCounts();
+  placeLayer(a, true, { 10, 20 });
+  placeLayer(b, true, { 25, 20 });
+  placeLayer(c, true, { 110, 15 });
+  TEST_ASSERT_TRUE(composeFrame());
+  checkFrame();
+  TEST_ASSERT_EQUAL_INT(40 + 10 + 25, renderedPixels[0]);
+
+  // An unchanged layer is not redrawn at all
+  resetCounts();
+  TEST_ASSERT_FALSE(composeFrame());
+  TEST_ASSERT_EQUAL_INT(0, renderedPixels[0]);
+
+  // Content change without a move redraws just that layer's span
+  markLayerChanged(b);
+  TEST_ASSERT_TRUE(composeFrame());
+  TEST_ASSERT_EQUAL_INT(20, renderedPixels[0]);
+  TEST_ASSERT_EQUAL_INT(20, renderedPixels[2]);
+  checkFrame();
+}
+
+// Scripted beam and tail walking back and forth over a background, like the
+// LED controller's layers, with a sparkle layer hopping about on top: every
+// frame of the damage-only redraw must match the full reference
+static void test_walker_matches_full_redraw() {
+  Layer &background = makeLayer(BLEND_REPLACE);
+  Layer &beam = makeLayer(BLEND_REPLACE);
+  Layer &tail = makeLayer(BLEND_ADD);
+  Layer &sparkle = makeLayer(BLEND_MAX);
+
+  const int frames = 9600;
+  for (int f = 0; f < frames; f++) {
+    int travelled = (f * 3) % (2 * STRIP_LENGTH);
+    int center = travelled <= STRIP_LENGTH ? travelled : 2 * STRIP_LENGTH - travelled;
+    bool forward = travelled <= STRIP_LENGTH;
+    int length = 6 + (f / 50) % 12;
+
+    // Background toggles every few hundred frames
+    placeLayer(background, (f / 300) % 3 != 0, { 0, STRIP_LENGTH });
+    placeLayer(beam, (f / 700) % 5 != 4, { center - length / 2, length });
+    placeLayer(tail, true, forward ? PixelSpan{ center - length / 2 - 20, 21 }
+                                   : PixelSpan{ center + length - length / 2 - 1, 21 });
+    placeLayer(sparkle, f % 7 != 0, { (f * 37) % (STRIP_LENGTH + 20) - 10, 1 + f % 9 });
+    if (f % 11 == 0) markLayerChanged(beam);
+
+    composeFrame();
+    checkFrame();
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_spans_are_clipped_at_both_ends);
+  RUN_TEST(test_blending_across_chunk_boundaries);
+  RUN_TEST(test_overlapping_damage_is_merged);
+  RUN_TEST(test_walker_matches_full_redraw);
+  return UNITY_END();
+}
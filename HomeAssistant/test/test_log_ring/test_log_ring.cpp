@@ -0,0 +1,138 @@
+// Log ring: records from several producer threads reach the reader exactly
+// once and in each producer's order, and every record that does not fit is
+// counted as dropped and reported.
+//   pio test -e native -f test_log_ring
+
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "log.h"
+
+#define PRODUCERS            4
+#define RECORDS_PER_PRODUCER 20000
+
+// Serial output of logFlush(), split into lines (println ends them with
+// "\r\n", the dropped report with "\n")
+static std::string pending;
+static std::vector<std::string> lines;
+
+static void captureSerial(const char *data, size_t length) {
+  pending.append(data, length);
+  size_t end;
+  while ((end = pending.find('\n')) != std::string::npos) {
+    size_t lineLength = (end > 0 && pending[end - 1] == '\r') ? end - 1 : end;
+    lines.push_back(pending.substr(0, lineLength));
+    pending.erase(0, end + 1);
+  }
+}
+
+// Results of checking the captured lines
+struct Received {
+  unsigned long records;
+  unsigned long duplicates;
+  unsigned long outOfOrder;
+  unsigned long droppedReported;
+};
+
+static Received checkLines() {
+  Received received = { 0, 0, 0, 0 };
+  std::vector<std::vector<bool>> seen(PRODUCERS, std::vector<bool>(RECORDS_PER_PRODUCER, false));
+  long last[PRODUCERS];
+  for (int p = 0; p < PRODUCERS; p++) last[p] = -1;
+
+  for (const std::string &line : lines) {
+    unsigned int producer, index;
+    unsigned long count;
+    if (sscanf(line.c_str(), "[%*u.%*u] I: record %u %u", &producer, &index) == 2) {
+      TEST_ASSERT_TRUE_MESSAGE(producer < PRODUCERS && index < RECORDS_PER_PRODUCER, line.c_str());
+      if (seen[producer][index]) received.duplicates++;
+      seen[producer][index] = true;
+      if ((long)index <= last[producer]) received.outOfOrder++;
+      last[producer] = index;
+      received.records++;
+    } else if (sscanf(line.c_str(), "[log] %lu message(s) dropped", &count) == 1) {
+      received.droppedReported += count;
+    } else {
+      TEST_FAIL_MESSAGE(line.c_str());
+    }
+  }
+  return received;
+}
+
+void setUp() {
+  initLog();
+  logFlush();   // report drops left over from an earlier test
+  lines.clear();
+  pending.clear();
+}
+
+void tearDown() {}
+
+// One producer, no reader: the ring takes LOG_RING_SIZE records and drops
+// the rest, which the next flush reports after the queued ones
+static void test_full_ring_drops_and_reports() {
+  uint32_t droppedBefore = getLogDropped();
+  const int extra = 10;
+  for (int i = 0; i < LOG_RING_SIZE + extra; i++) {
+    LOG_INFO("record %u %u", 0u, (unsigned)i);
+  }
+  TEST_ASSERT_EQUAL_UINT32(droppedBefore + extra, getLogDropped());
+
+  logFlush();
+  Received received = checkLines();
+  TEST_ASSERT_EQUAL_UINT32(LOG_RING_SIZE, received.records);
+  TEST_ASSERT_EQUAL_UINT32(extra, received.droppedReported);
+  TEST_ASSERT_EQUAL_UINT32(0, received.outOfOrder);
+  TEST_ASSERT_EQUAL_STRING("[log] 10 message(s) dropped", lines.back().c_str());
+
+  // Slots freed by the flush take records again
+  lines.clear();
+  LOG_INFO("record %u %u", 0u, 0u);
+  logFlush();
+  TEST_ASSERT_EQUAL_UINT32(1, lines.size());
+}
+
+// Producers racing each other and the reader: every record is either read
+// exactly once or counted as dropped
+static void test_concurrent_producers() {
+  uint32_t droppedBefore = getLogDropped();
+  std::atomic<int> running(PRODUCERS);
+  std::vector<std::thread> producers;
+
+  for (unsigned int p = 0; p < PRODUCERS; p++) {
+    producers.emplace_back([p, &running]() {
+      for (unsigned int i = 0; i < RECORDS_PER_PRODUCER; i++) {
+        LOG_INFO("record %u %u", p, i);
+        if (i % 64 == 0) std::this_thread::yield();
+      }
+      running.fetch_sub(1);
+    });
+  }
+  while (running.load() > 0) {
+    logFlush();
+  }
+  for (std::thread &producer : producers) producer.join();
+  logFlush();
+
+  Received received = checkLines();
+  uint32_t dropped = getLogDropped() - droppedBefore;
+  TEST_ASSERT_EQUAL_UINT32(0, received.duplicates);
+  TEST_ASSERT_EQUAL_UINT32(0, received.outOfOrder);
+  TEST_ASSERT_EQUAL_UINT32(PRODUCERS * RECORDS_PER_PRODUCER, received.records + dropped);
+  TEST_ASSERT_EQUAL_UINT32(dropped, received.droppedReported);
+  TEST_ASSERT_TRUE(received.records > 0);
+}
+
+int main(int argc, char **argv) {
+  nativeSerialCapture(captureSerial);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_full_ring_drops_and_reports);
+  RUN_TEST(test_concurrent_producers);
+  return UNITY_END();
+}
@@ -0,0 +1,142 @@
+// Render settings snapshot: every publish bumps the generation, and a reader
+// racing a writer thread only ever sees whole snapshots.
+//   pio test -e native -f test_render_params
+
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "config.h"
+#include "storage.h"
+
+#define READER_CHANGES  20000   // snapshots to see change before stopping
+#define READER_TIME_MS  2000    // or this long, on a machine with few cores
+
+static uint32_t generation() {
+  RenderParams params;
+  getRenderParams(params);
+  return params.generation;
+}
+
+// A batch in which every render field is derived from k, so a snapshot
+// mixing two batches is detectable
+static SettingsUpdate updateFor(int k) {
+  SettingsUpdate update = {};
+  update.fields = SETTING_UPDATE_INTERVAL | SETTING_LED_OFF_DELAY | SETTING_MOVING_INTENSITY |
+                  SETTING_MOVING_LENGTH | SETTING_CENTER_SHIFT | SETTING_ADDITIONAL_LEDS |
+                  SETTING_BASE_COLOR | SETTING_SPEED_MULTIPLIER;
+  update.updateInterval = k + 1;
+  update.ledOffDelay = k;
+  update.movingIntensity = k / 1000.0f;
+  update.movingLength = k + 1;
+  update.centerShift = -k;
+  update.additionalLEDs = k;
+  update.baseColor = CRGB(k & 0xFF, k >> 8, 0x5A);
+  update.speedMultiplier = k / 1000.0f;
+  return update;
+}
+
+static bool consistent(const RenderParams &params) {
+  int k = params.ledOffDelay;
+  return params.updateInterval == k + 1 &&
+         params.movingIntensity == k / 1000.0f &&
+         params.movingLength == k + 1 &&
+         params.centerShift == -k &&
+         params.additionalLEDs == k &&
+         params.baseColor == CRGB(k & 0xFF, k >> 8, 0x5A) &&
+         params.speedMultiplier == k / 1000.0f;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_every_publish_bumps_generation() {
+  uint32_t before = generation();
+  setUpdateInterval(25);
+  TEST_ASSERT_EQUAL_UINT32(before + 1, generation());
+  setMovingLength(40);
+  TEST_ASSERT_EQUAL_UINT32(before + 2, generation());
+  setBaseColor(CRGB(1, 2, 3));
+  TEST_ASSERT_EQUAL_UINT32(before + 3, generation());
+  // Same value again is still a publish
+  setBaseColor(CRGB(1, 2, 3));
+  TEST_ASSERT_EQUAL_UINT32(before + 4, generation());
+
+  // The light and background switches only publish real changes
+  setLightOn(true);
+  uint32_t lightBefore = generation();
+  setLightOn(false);
+  TEST_ASSERT_EQUAL_UINT32(lightBefore + 1, generation());
+  setLightOn(false);
+  TEST_ASSERT_EQUAL_UINT32(lightBefore + 1, generation());
+  setBackgroundModeActive(!isBackgroundModeActive());
+  TEST_ASSERT_EQUAL_UINT32(lightBefore + 2, generation());
+
+  // A batch is one publish; a rejected batch is none
+  before = generation();
+  TEST_ASSERT_TRUE(applySettings(updateFor(10)));
+  TEST_ASSERT_EQUAL_UINT32(before + 1, generation());
+  SettingsUpdate bad = updateFor(10);
+  bad.updateInterval = 0;
+  TEST_ASSERT_FALSE(applySettings(bad));
+  TEST_ASSERT_EQUAL_UINT32(before + 1, generation());
+
+  RenderParams params;
+  getRenderParams(params);
+  TEST_ASSERT_TRUE(consistent(params));
+}
+
+static void test_no_torn_snapshot_under_writer() {
+  TEST_ASSERT_TRUE(applySettings(updateFor(0)));
+  std::atomic<bool> reading(false);
+  std::atomic<bool> stop(false);
+  std::atomic<int> lastWritten(0);
+
+  // Publishes until the reader is done, starting once it is reading
+  std::thread writer([&]() {
+    while (!reading.load()) std::this_thread::yield();
+    for (int i = 1; !stop.load(); i++) {
+      applySettings(updateFor(i % 1000));
+      lastWritten.store(i % 1000);
+    }
+  });
+
+  unsigned long torn = 0;
+  unsigned long changes = 0;
+  unsigned long regressions = 0;
+  RenderParams last;
+  getRenderParams(last);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(READER_TIME_MS);
+  reading.store(true);
+  while (changes < READER_CHANGES && std::chrono::steady_clock::now() < deadline) {
+    RenderParams params;
+    getRenderParams(params);
+    if (!consistent(params)) torn++;
+    if (params.generation < last.generation) regressions++;
+    if (params.generation != last.generation) changes++;
+    last = params;
+  }
+  stop.store(true);
+  writer.join();
+
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, regressions);
+  // The reader did overlap the writer
+  TEST_ASSERT_TRUE(changes > 0);
+
+  getRenderParams(last);
+  TEST_ASSERT_TRUE(consistent(last));
+  TEST_ASSERT_EQUAL_INT(lastWritten.load(), last.ledOffDelay);
+}
+
+int main(int argc, char **argv) {
+  initStorage();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_every_publish_bumps_generation);
+  RUN_TEST(test_no_torn_snapshot_under_writer);
+  return UNITY_END();
+}
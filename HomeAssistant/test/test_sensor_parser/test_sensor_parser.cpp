@@ -0,0 +1,119 @@
+// Sensor frame parser: resynchronization after garbage, frames split across
+// reads and checksum failures, checked through the SensorStats counters.
+//   pio test -e native -f test_sensor_parser
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "sensor_manager.h"
+
+// A frame: 0xAA 0xAA, 0x00, distance little-endian, then the 8-bit sum of
+// the payload bytes before it
+static void buildFrame(uint8_t *frame, unsigned int distance) {
+  frame[0] = SENSOR_HEADER;
+  frame[1] = SENSOR_HEADER;
+  frame[2] = 0x00;
+  frame[3] = distance & 0xFF;
+  frame[4] = distance >> 8;
+  frame[5] = 0x00;
+  uint8_t sum = 0;
+  for (int i = 2; i < SENSOR_FRAME_LENGTH - 1; i++) sum += frame[i];
+  frame[SENSOR_FRAME_LENGTH - 1] = sum;
+}
+
+// Feed bytes and parse them; returns the distance readSensorData() reports,
+// which stays getSensorDistance() unless a frame was accepted
+static unsigned int feed(const uint8_t *bytes, size_t length) {
+  Serial1.nativeFeed(bytes, length);
+  return readSensorData();
+}
+
+static unsigned int feedFrame(unsigned int distance) {
+  uint8_t frame[SENSOR_FRAME_LENGTH];
+  buildFrame(frame, distance);
+  return feed(frame, sizeof(frame));
+}
+
+static SensorStats before;
+
+void setUp() {
+  // Every test starts in sync, after one good frame
+  feedFrame(MIN_DISTANCE + 100);
+  before = getSensorStats();
+}
+
+void tearDown() {}
+
+static void test_garbage_then_frame_resyncs_once() {
+  const uint8_t garbage[] = { 0x13, 0x37, 0x00, 0xFF, 0xAA, 0x42, 0x01 };
+  TEST_ASSERT_EQUAL_UINT32(getSensorDistance(), feed(garbage, sizeof(garbage)));
+  TEST_ASSERT_EQUAL_UINT32(MIN_DISTANCE + 200, feedFrame(MIN_DISTANCE + 200));
+
+  SensorStats after = getSensorStats();
+  TEST_ASSERT_EQUAL_UINT32(before.goodFrames + 1, after.goodFrames);
+  TEST_ASSERT_EQUAL_UINT32(before.resyncs + 1, after.resyncs);
+  TEST_ASSERT_EQUAL_UINT32(before.checksumErrors, after.checksumErrors);
+}
+
+static void test_split_frame_is_assembled() {
+  uint8_t frame[SENSOR_FRAME_LENGTH];
+  buildFrame(frame, MIN_DISTANCE + 300);
+
+  TEST_ASSERT_EQUAL_UINT32(getSensorDistance(), feed(frame, 3));
+  TEST_ASSERT_EQUAL_UINT32(MIN_DISTANCE + 300, feed(frame + 3, sizeof(frame) - 3));
+
+  SensorStats after = getSensorStats();
+  TEST_ASSERT_EQUAL_UINT32(before.goodFrames + 1, after.goodFrames);
+  TEST_ASSERT_EQUAL_UINT32(before.resyncs, after.resyncs);
+}
+
+static void test_bad_checksum_is_rejected() {
+  uint8_t frame[SENSOR_FRAME_LENGTH];
+  buildFrame(frame, MIN_DISTANCE + 400);
+  frame[SENSOR_FRAME_LENGTH - 1] ^= 0x5A;
+  TEST_ASSERT_EQUAL_UINT32(getSensorDistance(), feed(frame, sizeof(frame)));
+
+  SensorStats after = getSensorStats();
+  TEST_ASSERT_EQUAL_UINT32(before.goodFrames, after.goodFrames);
+  TEST_ASSERT_EQUAL_UINT32(before.checksumErrors + 1, after.checksumErrors);
+  TEST_ASSERT_EQUAL_UINT32(before.resyncs + 1, after.resyncs);
+
+  // The next good frame is taken as usual
+  TEST_ASSERT_EQUAL_UINT32(MIN_DISTANCE + 500, feedFrame(MIN_DISTANCE + 500));
+  TEST_ASSERT_EQUAL_UINT32(before.goodFrames + 1, getSensorStats().goodFrames);
+}
+
+// A stray header byte right before a frame makes the parser read the frame
+// one byte late; the rescan of the bad frame has to find the real header
+// starting at its second byte
+static void test_header_at_second_byte_is_found() {
+  uint8_t stream[1 + SENSOR_FRAME_LENGTH];
+  stream[0] = SENSOR_HEADER;
+  buildFrame(stream + 1, MIN_DISTANCE + 600);
+  TEST_ASSERT_EQUAL_UINT32(MIN_DISTANCE + 600, feed(stream, sizeof(stream)));
+
+  SensorStats after = getSensorStats();
+  TEST_ASSERT_EQUAL_UINT32(before.checksumErrors + 1, after.checksumErrors);
+  TEST_ASSERT_EQUAL_UINT32(before.goodFrames + 1, after.goodFrames);
+}
+
+static void test_out_of_range_is_counted_not_accepted() {
+  TEST_ASSERT_EQUAL_UINT32(getSensorDistance(), feedFrame(MAX_DISTANCE + 1));
+
+  SensorStats after = getSensorStats();
+  TEST_ASSERT_EQUAL_UINT32(before.goodFrames + 1, after.goodFrames);
+  TEST_ASSERT_EQUAL_UINT32(before.outOfRange + 1, after.outOfRange);
+}
+
+int main(int argc, char **argv) {
+  initSensor();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_garbage_then_frame_resyncs_once);
+  RUN_TEST(test_split_frame_is_assembled);
+  RUN_TEST(test_bad_checksum_is_rejected);
+  RUN_TEST(test_header_at_second_byte_is_found);
+  RUN_TEST(test_out_of_range_is_counted_not_accepted);
+  return UNITY_END();
+}
@@ -0,0 +1,191 @@
+// Batched settings updates: a batch with any field out of range is rejected
+// as a whole, with validateSettings() naming that field; a valid batch is
+// applied in full.
+//   pio test -e native -f test_settings_batch
+
+#include <Arduino.h>
+#include <math.h>
+#include <unity.h>
+
+#include "config.h"
+#include "storage.h"
+
+// Every setting a batch can touch, as the getters report it
+struct Settings {
+  int updateInterval;
+  int ledOffDelay;
+  float movingIntensity;
+  float stationaryIntensity;
+  int movingLength;
+  int centerShift;
+  int additionalLEDs;
+  CRGB baseColor;
+  float speedMultiplier;
+  int numLeds;
+  int startHour;
+  int startMinute;
+  int endHour;
+  int endMinute;
+  bool backgroundMode;
+  uint32_t generation;
+};
+
+static Settings current() {
+  RenderParams params;
+  getRenderParams(params);
+  return { getUpdateInterval(), getLedOffDelay(), getMovingIntensity(), getStationaryIntensity(),
+           getMovingLength(), getCenterShift(), getAdditionalLEDs(), getBaseColor(),
+           getSpeedMultiplier(), getNumLeds(), getStartHour(), getStartMinute(),
+           getEndHour(), getEndMinute(), isBackgroundModeActive(), params.generation };
+}
+
+static void checkUnchanged(const Settings &before, const char *message) {
+  Settings after = current();
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.updateInterval, after.updateInterval, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.ledOffDelay, after.ledOffDelay, message);
+  TEST_ASSERT_TRUE_MESSAGE(before.movingIntensity == after.movingIntensity, message);
+  TEST_ASSERT_TRUE_MESSAGE(before.stationaryIntensity == after.stationaryIntensity, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.movingLength, after.movingLength, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.centerShift, after.centerShift, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.additionalLEDs, after.additionalLEDs, message);
+  TEST_ASSERT_TRUE_MESSAGE(before.baseColor == after.baseColor, message);
+  TEST_ASSERT_TRUE_MESSAGE(before.speedMultiplier == after.speedMultiplier, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.numLeds, after.numLeds, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.startHour, after.startHour, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.startMinute, after.startMinute, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.endHour, after.endHour, message);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(before.endMinute, after.endMinute, message);
+  TEST_ASSERT_TRUE_MESSAGE(before.backgroundMode == after.backgroundMode, message);
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(before.generation, after.generation, message);
+}
+
+// A batch touching every field, all in range and all different from the
+// values set up in setUp()
+static SettingsUpdate fullUpdate() {
+  SettingsUpdate update = {};
+  update.fields = SETTING_UPDATE_INTERVAL | SETTING_LED_OFF_DELAY | SETTING_MOVING_INTENSITY |
+                  SETTING_STATIONARY_INTENSITY | SETTING_MOVING_LENGTH | SETTING_CENTER_SHIFT |
+                  SETTING_ADDITIONAL_LEDS | SETTING_BASE_COLOR | SETTING_SPEED_MULTIPLIER |
+                  SETTING_NUM_LEDS | SETTING_SCHEDULE | SETTING_BACKGROUND_MODE;
+  update.updateInterval = 40;
+  update.ledOffDelay = 9;
+  update.movingIntensity = 0.7f;
+  update.stationaryIntensity = 0.05f;
+  update.movingLength = 60;
+  update.centerShift = -12;
+  update.additionalLEDs = 5;
+  update.baseColor = CRGB(1, 2, 3);
+  update.speedMultiplier = 2.5f;
+  update.numLeds = 450;
+  update.startHour = 18;
+  update.startMinute = 10;
+  update.endHour = 7;
+  update.endMinute = 20;
+  update.backgroundMode = true;
+  return update;
+}
+
+void setUp() {
+  setUpdateInterval(DEFAULT_UPDATE_INTERVAL);
+  setLedOffDelay(DEFAULT_LED_OFF_DELAY);
+  setMovingIntensity(DEFAULT_MOVING_INTENSITY);
+  setStationaryIntensity(DEFAULT_STATIONARY_INTENSITY);
+  setMovingLength(DEFAULT_MOVING_LENGTH);
+  setCenterShift(DEFAULT_CENTER_SHIFT);
+  setAdditionalLEDs(DEFAULT_ADDITIONAL_LEDS);
+  setBaseColor(DEFAULT_BASE_COLOR);
+  setSpeedMultiplier(DEFAULT_SPEED_MULTIPLIER);
+  setNumLeds(DEFAULT_NUM_LEDS);
+  setStartHour(DEFAULT_START_HOUR);
+  setStartMinute(DEFAULT_START_MINUTE);
+  setEndHour(DEFAULT_END_HOUR);
+  setEndMinute(DEFAULT_END_MINUTE);
+  setBackgroundModeActive(false);
+  flushSettings(true);
+  takeStateChanges();
+}
+
+void tearDown() {}
+
+static void test_valid_batch_is_applied_in_full() {
+  SettingsUpdate update = fullUpdate();
+  TEST_ASSERT_EQUAL_UINT32(0, validateSettings(update));
+  TEST_ASSERT_TRUE(applySettings(update));
+
+  TEST_ASSERT_EQUAL_INT(40, getUpdateInterval());
+  TEST_ASSERT_EQUAL_INT(9, getLedOffDelay());
+  TEST_ASSERT_EQUAL_FLOAT(0.7f, getMovingIntensity());
+  TEST_ASSERT_EQUAL_FLOAT(0.05f, getStationaryIntensity());
+  TEST_ASSERT_EQUAL_INT(60, getMovingLength());
+  TEST_ASSERT_EQUAL_INT(-12, getCenterShift());
+  TEST_ASSERT_EQUAL_INT(5, getAdditionalLEDs());
+  TEST_ASSERT_TRUE(getBaseColor() == CRGB(1, 2, 3));
+  TEST_ASSERT_EQUAL_FLOAT(2.5f, getSpeedMultiplier());
+  TEST_ASSERT_EQUAL_INT(450, getNumLeds());
+  TEST_ASSERT_EQUAL_INT(18, getStartHour());
+  TEST_ASSERT_EQUAL_INT(20, getEndMinute());
+  TEST_ASSERT_TRUE(isBackgroundModeActive());
+  TEST_ASSERT_EQUAL_UINT32(update.fields, takeStateChanges());
+}
+
+// One field out of range in an otherwise valid batch
+struct BadField {
+  uint32_t field;
+  const char *name;
+  void (*spoil)(SettingsUpdate &update);
+};
+
+static const BadField badFields[] = {
+  { SETTING_UPDATE_INTERVAL, "update interval", [](SettingsUpdate &u) { u.updateInterval = 0; } },
+  { SETTING_LED_OFF_DELAY, "LED off delay", [](SettingsUpdate &u) { u.ledOffDelay = -1; } },
+  { SETTING_MOVING_INTENSITY, "moving intensity", [](SettingsUpdate &u) { u.movingIntensity = NAN; } },
+  { SETTING_STATIONARY_INTENSITY, "stationary intensity", [](SettingsUpdate &u) { u.stationaryIntensity = 0.5f; } },
+  { SETTING_MOVING_LENGTH, "moving length", [](SettingsUpdate &u) { u.movingLength = MAX_NUM_LEDS + 1; } },
+  { SETTING_CENTER_SHIFT, "center shift", [](SettingsUpdate &u) { u.centerShift = -MAX_NUM_LEDS - 1; } },
+  { SETTING_ADDITIONAL_LEDS, "additional LEDs", [](SettingsUpdate &u) { u.additionalLEDs = -1; } },
+  { SETTING_SPEED_MULTIPLIER, "speed multiplier", [](SettingsUpdate &u) { u.speedMultiplier = MAX_SPEED_MULTIPLIER + 1; } },
+  { SETTING_NUM_LEDS, "LED count", [](SettingsUpdate &u) { u.numLeds = 0; } },
+  { SETTING_SCHEDULE, "schedule", [](SettingsUpdate &u) { u.endMinute = 60; } },
+};
+
+static void test_one_bad_field_rejects_the_batch() {
+  for (const BadField &bad : badFields) {
+    SettingsUpdate update = fullUpdate();
+    bad.spoil(update);
+    Settings before = current();
+    uint32_t commitsBefore = getStorageStats().commits;
+
+    TEST_ASSERT_EQUAL_HEX32_MESSAGE(bad.field, validateSettings(update), bad.name);
+    TEST_ASSERT_FALSE_MESSAGE(applySettings(update), bad.name);
+
+    checkUnchanged(before, bad.name);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, takeStateChanges(), bad.name);
+    // Nothing pending either
+    TEST_ASSERT_FALSE_MESSAGE(flushSettings(true), bad.name);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(commitsBefore, getStorageStats().commits, bad.name);
+  }
+}
+
+// A bad value in a field the batch does not set is ignored
+static void test_unset_fields_are_not_checked() {
+  SettingsUpdate update = {};
+  update.fields = SETTING_MOVING_LENGTH;
+  update.movingLength = 70;
+  update.updateInterval = 0;
+  update.numLeds = -5;
+  TEST_ASSERT_EQUAL_UINT32(0, validateSettings(update));
+  TEST_ASSERT_TRUE(applySettings(update));
+  TEST_ASSERT_EQUAL_INT(70, getMovingLength());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_UPDATE_INTERVAL, getUpdateInterval());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_NUM_LEDS, getNumLeds());
+}
+
+int main(int argc, char **argv) {
+  initStorage();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_valid_batch_is_applied_in_full);
+  RUN_TEST(test_one_bad_field_rejects_the_batch);
+  RUN_TEST(test_unset_fields_are_not_checked);
+  return UNITY_END();
+}
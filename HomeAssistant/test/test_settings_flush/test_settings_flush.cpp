@@ -0,0 +1,102 @@
+// Write-behind settings: a burst of setter calls is written to flash once,
+// after the quiet period, or after the maximum delay if it never goes quiet.
+//   pio test -e native -f test_settings_flush
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "storage.h"
+
+#define CHANGES  20
+
+static uint32_t commits() {
+  return getStorageStats().commits;
+}
+
+// Let time pass the way storageTask sees it: a flush check every poll
+// interval; returns how many of the checks wrote
+static int poll(unsigned long ms) {
+  int writes = 0;
+  for (unsigned long t = 0; t < ms; t += SETTINGS_FLUSH_POLL) {
+    nativeAdvanceMillis(SETTINGS_FLUSH_POLL);
+    if (flushSettings()) writes++;
+  }
+  return writes;
+}
+
+void setUp() {
+  // Start with nothing pending
+  flushSettings(true);
+}
+
+void tearDown() {}
+
+static void test_burst_is_written_once() {
+  uint32_t before = commits();
+  for (int i = 0; i < CHANGES; i++) {
+    setMovingLength(10 + i);
+    setBaseColor(CRGB(i, 0, 0));
+    TEST_ASSERT_EQUAL_INT(0, poll(SETTINGS_FLUSH_POLL));
+  }
+  TEST_ASSERT_EQUAL_UINT32(before, commits());
+
+  // Written once the changes stop for the quiet period, and not again
+  TEST_ASSERT_EQUAL_INT(1, poll(SETTINGS_FLUSH_QUIET));
+  TEST_ASSERT_EQUAL_UINT32(before + 1, commits());
+  TEST_ASSERT_EQUAL_INT(0, poll(SETTINGS_FLUSH_MAX_DELAY));
+  TEST_ASSERT_EQUAL_UINT32(before + 1, commits());
+}
+
+// Changes closer together than the quiet period never let it expire; the
+// maximum delay bounds how long they stay unwritten
+static void test_long_burst_is_written_after_max_delay() {
+  uint32_t before = commits();
+  unsigned long elapsed = 0;
+  int writes = 0;
+  while (elapsed < SETTINGS_FLUSH_MAX_DELAY + SETTINGS_FLUSH_QUIET / 2) {
+    setUpdateInterval(20 + (elapsed / 1000) % 10);
+    writes += poll(SETTINGS_FLUSH_QUIET / 2);
+    elapsed += SETTINGS_FLUSH_QUIET / 2;
+  }
+  TEST_ASSERT_EQUAL_INT(1, writes);
+  TEST_ASSERT_EQUAL_UINT32(before + 1, commits());
+
+  // The changes after that write go out once things are quiet
+  TEST_ASSERT_EQUAL_INT(1, poll(SETTINGS_FLUSH_QUIET));
+  TEST_ASSERT_EQUAL_UINT32(before + 2, commits());
+}
+
+// A batch update is written on the next check, without the quiet period
+static void test_batch_is_written_on_next_check() {
+  uint32_t before = commits();
+  SettingsUpdate update = {};
+  update.fields = SETTING_MOVING_LENGTH | SETTING_CENTER_SHIFT;
+  update.movingLength = 42;
+  update.centerShift = 3;
+  TEST_ASSERT_TRUE(applySettings(update));
+
+  TEST_ASSERT_TRUE(flushSettings());
+  TEST_ASSERT_EQUAL_UINT32(before + 1, commits());
+  TEST_ASSERT_EQUAL_INT(0, poll(SETTINGS_FLUSH_MAX_DELAY));
+}
+
+// Light and background switches are not saved settings
+static void test_light_switches_are_not_written() {
+  uint32_t before = commits();
+  setLightOn(!isLightOn());
+  setBackgroundModeActive(!isBackgroundModeActive());
+  TEST_ASSERT_EQUAL_INT(0, poll(SETTINGS_FLUSH_MAX_DELAY));
+  TEST_ASSERT_EQUAL_UINT32(before, commits());
+}
+
+int main(int argc, char **argv) {
+  initStorage();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_is_written_once);
+  RUN_TEST(test_long_burst_is_written_after_max_delay);
+  RUN_TEST(test_batch_is_written_on_next_check);
+  RUN_TEST(test_light_switches_are_not_written);
+  return UNITY_END();
+}
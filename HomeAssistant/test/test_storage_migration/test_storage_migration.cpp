@@ -0,0 +1,287 @@
+// Settings record loading: an older record version is read as a prefix of
+// the current layout, a damaged record falls back to defaults, out-of-range
+// values are replaced, and the pre-record EEPROM/NVS settings are migrated
+// once and their keys removed.
+//   pio test -e native -f test_storage_migration
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Preferences.h>
+#include <math.h>
+#include <unity.h>
+
+#include "config.h"
+#include "storage.h"
+
+// The record layout as written to NVS, mirrored from storage.cpp: the
+// header, then the version 1 payload, then the fields version 2 appended
+#define SETTINGS_KEY    "settings"
+#define SETTINGS_MAGIC  0x4C545253UL
+
+struct __attribute__((packed)) Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint32_t crc;
+};
+
+struct __attribute__((packed)) PayloadV1 {
+  int32_t updateInterval;
+  int32_t ledOffDelay;
+  float movingIntensity;
+  float stationaryIntensity;
+  int32_t movingLength;
+  int32_t centerShift;
+  int32_t additionalLEDs;
+  uint8_t baseColor[3];
+  float speedMultiplier;
+  uint8_t startHour;
+  uint8_t startMinute;
+  uint8_t endHour;
+  uint8_t endMinute;
+  char wifiSsid[33];
+  char wifiPassword[65];
+  char mqttServer[65];
+  uint16_t mqttPort;
+  char mqttUser[65];
+  char mqttPassword[65];
+};
+
+struct __attribute__((packed)) RecordV1 {
+  Header header;
+  PayloadV1 data;
+};
+
+// Version 2 appended a uint16_t LED count
+#define CURRENT_RECORD_SIZE  (sizeof(RecordV1) + sizeof(uint16_t))
+
+static Preferences nvs;
+
+static uint32_t crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static void buildV1Record(RecordV1 &record) {
+  memset(&record, 0, sizeof(record));
+  record.data.updateInterval = 33;
+  record.data.ledOffDelay = 12;
+  record.data.movingIntensity = 0.6f;
+  record.data.stationaryIntensity = 0.04f;
+  record.data.movingLength = 51;
+  record.data.centerShift = -7;
+  record.data.additionalLEDs = 4;
+  record.data.baseColor[0] = 10;
+  record.data.baseColor[1] = 20;
+  record.data.baseColor[2] = 30;
+  record.data.speedMultiplier = 1.5f;
+  record.data.startHour = 19;
+  record.data.startMinute = 15;
+  record.data.endHour = 6;
+  record.data.endMinute = 45;
+  strcpy(record.data.wifiSsid, "HomeNet");
+  strcpy(record.data.wifiPassword, "secret");
+  strcpy(record.data.mqttServer, "10.0.0.2");
+  record.data.mqttPort = 1884;
+  strcpy(record.data.mqttUser, "light");
+  strcpy(record.data.mqttPassword, "track");
+
+  record.header.magic = SETTINGS_MAGIC;
+  record.header.version = 1;
+  record.header.length = sizeof(PayloadV1);
+  record.header.crc = crc32((const uint8_t *)&record.data, sizeof(PayloadV1));
+}
+
+static void storeRecord(const RecordV1 &record) {
+  nvs.putBytes(SETTINGS_KEY, &record, sizeof(record));
+}
+
+// Check NVS holds a valid record of the current version
+static void checkCurrentRecord() {
+  TEST_ASSERT_EQUAL_UINT32(CURRENT_RECORD_SIZE, nvs.getBytesLength(SETTINGS_KEY));
+  uint8_t stored[CURRENT_RECORD_SIZE];
+  nvs.getBytes(SETTINGS_KEY, stored, sizeof(stored));
+  Header header;
+  memcpy(&header, stored, sizeof(header));
+  TEST_ASSERT_EQUAL_HEX32(SETTINGS_MAGIC, header.magic);
+  TEST_ASSERT_EQUAL_UINT16(2, header.version);
+  TEST_ASSERT_EQUAL_UINT16(CURRENT_RECORD_SIZE - sizeof(Header), header.length);
+  TEST_ASSERT_EQUAL_HEX32(crc32(stored + sizeof(Header), header.length), header.crc);
+}
+
+static void checkDefaults() {
+  TEST_ASSERT_EQUAL_INT(DEFAULT_UPDATE_INTERVAL, getUpdateInterval());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_LED_OFF_DELAY, getLedOffDelay());
+  TEST_ASSERT_EQUAL_FLOAT(DEFAULT_MOVING_INTENSITY, getMovingIntensity());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_MOVING_LENGTH, getMovingLength());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_START_HOUR, getStartHour());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_NUM_LEDS, getNumLeds());
+  TEST_ASSERT_EQUAL_INT(MQTT_PORT, getMqttPort());
+}
+
+void setUp() {
+  // Start every test from empty NVS and a blank EEPROM
+  nvs.begin("lighttrack", false);
+  nvs.clear();
+  EEPROM.begin(EEPROM_SIZE);
+  for (int i = 0; i < EEPROM_SIZE; i++) EEPROM.write(i, 0);
+}
+
+void tearDown() {}
+
+static void test_v1_record_is_read_as_prefix() {
+  RecordV1 record;
+  buildV1Record(record);
+  storeRecord(record);
+  setNumLeds(DEFAULT_NUM_LEDS + 100);
+
+  loadSettings();
+
+  TEST_ASSERT_EQUAL_INT(33, getUpdateInterval());
+  TEST_ASSERT_EQUAL_INT(12, getLedOffDelay());
+  TEST_ASSERT_EQUAL_FLOAT(0.6f, getMovingIntensity());
+  TEST_ASSERT_EQUAL_FLOAT(0.04f, getStationaryIntensity());
+  TEST_ASSERT_EQUAL_INT(51, getMovingLength());
+  TEST_ASSERT_EQUAL_INT(-7, getCenterShift());
+  TEST_ASSERT_EQUAL_INT(4, getAdditionalLEDs());
+  TEST_ASSERT_TRUE(getBaseColor() == CRGB(10, 20, 30));
+  TEST_ASSERT_EQUAL_FLOAT(1.5f, getSpeedMultiplier());
+  TEST_ASSERT_EQUAL_INT(19, getStartHour());
+  TEST_ASSERT_EQUAL_INT(45, getEndMinute());
+  TEST_ASSERT_EQUAL_STRING("HomeNet", getWiFiSSID().c_str());
+  TEST_ASSERT_EQUAL_STRING("10.0.0.2", getMqttServer().c_str());
+  TEST_ASSERT_EQUAL_INT(1884, getMqttPort());
+  TEST_ASSERT_EQUAL_STRING("track", getMqttPassword().c_str());
+  // Appended in version 2, so it keeps its default
+  TEST_ASSERT_EQUAL_INT(DEFAULT_NUM_LEDS, getNumLeds());
+
+  // A valid older record costs no flash write at boot; it is upgraded by
+  // the next save
+  TEST_ASSERT_EQUAL_UINT32(sizeof(RecordV1), nvs.getBytesLength(SETTINGS_KEY));
+  saveSettings();
+  checkCurrentRecord();
+}
+
+static void test_corrupt_crc_falls_back_to_defaults() {
+  RecordV1 record;
+  buildV1Record(record);
+  record.data.movingLength ^= 0x100;
+  storeRecord(record);
+
+  loadSettings();
+
+  checkDefaults();
+  checkCurrentRecord();
+}
+
+static void test_truncated_record_falls_back_to_defaults() {
+  RecordV1 record;
+  buildV1Record(record);
+  nvs.putBytes(SETTINGS_KEY, &record, sizeof(record) - 10);
+
+  loadSettings();
+
+  checkDefaults();
+  checkCurrentRecord();
+}
+
+static void test_out_of_range_values_get_defaults() {
+  RecordV1 record;
+  buildV1Record(record);
+  record.data.updateInterval = 0;
+  record.data.movingIntensity = NAN;
+  record.data.startHour = 24;
+  record.header.crc = crc32((const uint8_t *)&record.data, sizeof(PayloadV1));
+  storeRecord(record);
+
+  loadSettings();
+
+  TEST_ASSERT_EQUAL_INT(DEFAULT_UPDATE_INTERVAL, getUpdateInterval());
+  TEST_ASSERT_EQUAL_FLOAT(DEFAULT_MOVING_INTENSITY, getMovingIntensity());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_START_HOUR, getStartHour());
+  // The rest of the record is kept
+  TEST_ASSERT_EQUAL_INT(12, getLedOffDelay());
+  TEST_ASSERT_EQUAL_INT(51, getMovingLength());
+  TEST_ASSERT_EQUAL_INT(15, getStartMinute());
+}
+
+// No record yet: display values at the old fixed EEPROM offsets, the
+// credentials in their own NVS keys
+static void test_legacy_settings_migrate_once() {
+  int offset = 0;
+  EEPROM.put(offset, (int32_t)40); offset += sizeof(int32_t);    // update interval
+  EEPROM.put(offset, (int32_t)9); offset += sizeof(int32_t);     // LED off delay
+  EEPROM.put(offset, 0.5f); offset += sizeof(float);             // moving intensity
+  EEPROM.put(offset, 0.02f); offset += sizeof(float);            // stationary intensity
+  EEPROM.put(offset, (int32_t)60); offset += sizeof(int32_t);    // moving length
+  EEPROM.put(offset, (int32_t)3); offset += sizeof(int32_t);     // center shift
+  EEPROM.put(offset, (int32_t)2); offset += sizeof(int32_t);     // additional LEDs
+  EEPROM.put(offset, CRGB(1, 2, 3)); offset += sizeof(CRGB);     // base color
+  EEPROM.put(offset, 2.0f); offset += sizeof(float);             // speed multiplier
+  EEPROM.put(offset, (int32_t)21); offset += sizeof(int32_t);    // start hour
+  EEPROM.put(offset, (int32_t)99); offset += sizeof(int32_t);    // start minute, out of range
+  EEPROM.put(offset, (int32_t)7); offset += sizeof(int32_t);     // end hour
+  EEPROM.put(offset, (int32_t)5);                                // end minute
+
+  nvs.putString("wifi_ssid", "OldNet");
+  nvs.putString("wifi_password", "oldpass");
+  nvs.putString("mqtt_server", "10.0.0.9");
+  nvs.putInt("mqtt_port", 1999);
+  nvs.putString("mqtt_user", "olduser");
+  nvs.putString("mqtt_password", "oldmqtt");
+
+  loadSettings();
+
+  TEST_ASSERT_EQUAL_INT(40, getUpdateInterval());
+  TEST_ASSERT_EQUAL_INT(9, getLedOffDelay());
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, getMovingIntensity());
+  TEST_ASSERT_EQUAL_INT(60, getMovingLength());
+  TEST_ASSERT_TRUE(getBaseColor() == CRGB(1, 2, 3));
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, getSpeedMultiplier());
+  TEST_ASSERT_EQUAL_INT(21, getStartHour());
+  TEST_ASSERT_EQUAL_INT(DEFAULT_START_MINUTE, getStartMinute());
+  TEST_ASSERT_EQUAL_INT(5, getEndMinute());
+  TEST_ASSERT_EQUAL_STRING("OldNet", getWiFiSSID().c_str());
+  TEST_ASSERT_EQUAL_STRING("oldpass", getWiFiPassword().c_str());
+  TEST_ASSERT_EQUAL_STRING("10.0.0.9", getMqttServer().c_str());
+  TEST_ASSERT_EQUAL_INT(1999, getMqttPort());
+  TEST_ASSERT_EQUAL_STRING("oldmqtt", getMqttPassword().c_str());
+
+  checkCurrentRecord();
+  const char *legacyKeys[] = { "wifi_ssid", "wifi_password", "mqtt_server", "mqtt_port", "mqtt_user", "mqtt_password" };
+  for (const char *key : legacyKeys) {
+    TEST_ASSERT_FALSE_MESSAGE(nvs.isKey(key), key);
+  }
+
+  // The next boot reads the record; a later EEPROM value is not taken again
+  EEPROM.put(0, (int32_t)80);
+  loadSettings();
+  TEST_ASSERT_EQUAL_INT(40, getUpdateInterval());
+  TEST_ASSERT_EQUAL_STRING("OldNet", getWiFiSSID().c_str());
+}
+
+// A fresh device: blank EEPROM, no keys at all
+static void test_blank_device_gets_defaults() {
+  loadSettings();
+  checkDefaults();
+  checkCurrentRecord();
+}
+
+int main(int argc, char **argv) {
+  initStorage();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_v1_record_is_read_as_prefix);
+  RUN_TEST(test_corrupt_crc_falls_back_to_defaults);
+  RUN_TEST(test_truncated_record_falls_back_to_defaults);
+  RUN_TEST(test_out_of_range_values_get_defaults);
+  RUN_TEST(test_legacy_settings_migrate_once);
+  RUN_TEST(test_blank_device_gets_defaults);
+  return UNITY_END();
+}
@@ -0,0 +1,126 @@
+// A walker leaves the sensor range, or the sensor goes quiet: the track has
+// to stop reporting motion and the strip has to go dark after the off delay.
+//   pio test -e native -f test_track_expiry
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <unity.h>
+
+#include "config.h"
+#include "led_controller.h"
+#include "sensor_manager.h"
+#include "storage.h"
+
+#define FRAME_MS      20
+#define OFF_DELAY_S   2
+#define WALK_SPEED    400   // distance units per second
+
+static void feedDistance(unsigned int distance) {
+  uint8_t frame[SENSOR_FRAME_LENGTH] = {
+    SENSOR_HEADER, SENSOR_HEADER, 0x00,
+    (uint8_t)(distance & 0xFF), (uint8_t)(distance >> 8)
+  };
+  uint8_t sum = 0;
+  for (int i = 2; i < SENSOR_FRAME_LENGTH - 1; i++) sum += frame[i];
+  frame[SENSOR_FRAME_LENGTH - 1] = sum;
+  Serial1.nativeFeed(frame, sizeof(frame));
+  processSensorData();
+}
+
+static int litLeds() {
+  int lit = 0;
+  for (int c = 0; c < FastLED.count(); c++) {
+    CRGB *leds = FastLED[c].leds();
+    for (int i = 0; i < FastLED[c].size(); i++) {
+      if (leds[i].r || leds[i].g || leds[i].b) lit++;
+    }
+  }
+  return lit;
+}
+
+static void frame() {
+  updateLEDFrame();
+  nativeAdvanceMillis(FRAME_MS);
+}
+
+// Walk away from the sensor for two seconds at WALK_SPEED
+static void walk() {
+  unsigned int distance = MIN_DISTANCE + 50;
+  for (int i = 0; i < 2000 / FRAME_MS; i++) {
+    distance += WALK_SPEED * FRAME_MS / 1000;
+    feedDistance(distance);
+    frame();
+  }
+  TEST_ASSERT_TRUE(getSensorTrack().confidence >= TRACK_MIN_CONFIDENCE);
+  TEST_ASSERT_TRUE(getSensorTrack().velocity > WALK_SPEED / 2);
+  TEST_ASSERT_TRUE(litLeds() > 0);
+}
+
+// Run frames for ms, feeding out-of-range frames or nothing at all
+static void wait(unsigned long ms, bool outOfRange) {
+  for (unsigned long t = 0; t < ms; t += FRAME_MS) {
+    if (outOfRange) feedDistance(MAX_DISTANCE + 500);
+    frame();
+  }
+}
+
+static void checkExpired() {
+  SensorTrack track = getSensorTrack();
+  TEST_ASSERT_EQUAL_UINT8(0, track.confidence);
+  TEST_ASSERT_TRUE(track.velocity == 0.0f);
+}
+
+void setUp() {
+  setLightOn(true);
+  setBackgroundModeActive(false);
+  setLedOffDelay(OFF_DELAY_S);
+  setMovingLength(DEFAULT_MOVING_LENGTH);
+  setMovingIntensity(DEFAULT_MOVING_INTENSITY);
+  setBaseColor(DEFAULT_BASE_COLOR);
+  setAdditionalLEDs(0);
+  setCenterShift(0);
+}
+
+void tearDown() {}
+
+static void test_walker_leaves_range() {
+  walk();
+  // Still lit within the off delay, dark after it and the track timeout
+  wait(OFF_DELAY_S * 1000 / 2, true);
+  TEST_ASSERT_TRUE(litLeds() > 0);
+  wait(OFF_DELAY_S * 1000 / 2 + TRACK_RESET_TIMEOUT + 2 * FRAME_MS, true);
+  checkExpired();
+  TEST_ASSERT_EQUAL_INT(0, litLeds());
+
+  // And stays dark
+  wait(60000, true);
+  checkExpired();
+  TEST_ASSERT_EQUAL_INT(0, litLeds());
+}
+
+static void test_sensor_goes_silent() {
+  walk();
+  wait(OFF_DELAY_S * 1000 + TRACK_RESET_TIMEOUT + 2 * FRAME_MS, false);
+  checkExpired();
+  TEST_ASSERT_EQUAL_INT(0, litLeds());
+}
+
+static void test_walker_returns_after_expiry() {
+  walk();
+  wait(OFF_DELAY_S * 1000 + TRACK_RESET_TIMEOUT + 2 * FRAME_MS, false);
+  TEST_ASSERT_EQUAL_INT(0, litLeds());
+  // A new walk restarts the track and lights the beam again
+  walk();
+}
+
+int main(int argc, char **argv) {
+  initStorage();
+  initSensor();
+  initLEDController();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_walker_leaves_range);
+  RUN_TEST(test_sensor_goes_silent);
+  RUN_TEST(test_walker_returns_after_expiry);
+  return UNITY_END();
+}
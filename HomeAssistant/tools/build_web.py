@@ -0,0 +1,67 @@
+"""Build the LittleFS image contents from the web UI sources.
+
+Every file in web/ is gzipped into data/<name>.gz, which is what the
+firmware serves. References to /style.css and /app.js in the pages get a
+?v=<content hash> suffix, so those files can be cached for a long time and
+still update with a new image.
+
+Runs before every build of the firmware environment (extra_scripts in
+platformio.ini), or by hand:
+
+    python tools/build_web.py
+    pio run -t uploadfs
+"""
+
+import gzip
+import hashlib
+import os
+import re
+
+
+def build(project_dir):
+    source_dir = os.path.join(project_dir, "web")
+    output_dir = os.path.join(project_dir, "data")
+    os.makedirs(output_dir, exist_ok=True)
+
+    sources = {}
+    for name in sorted(os.listdir(source_dir)):
+        with open(os.path.join(source_dir, name), "rb") as f:
+            sources[name] = f.read()
+
+    versions = {
+        name: hashlib.sha1(content).hexdigest()[:8]
+        for name, content in sources.items()
+        if not name.endswith(".html")
+    }
+
+    def versioned(match):
+        name = match.group(2)
+        if name not in versions:
+            return match.group(0)
+        return '%s="/%s?v=%s"' % (match.group(1), name, versions[name])
+
+    outputs = set()
+    for name, content in sources.items():
+        if name.endswith(".html"):
+            html = re.sub(r'(src|href)="/([\w.-]+)"', versioned, content.decode("utf-8"))
+            content = html.encode("utf-8")
+        output = name + ".gz"
+        outputs.add(output)
+        # mtime=0 keeps the output identical for identical input
+        data = gzip.compress(content, compresslevel=9, mtime=0)
+        path = os.path.join(output_dir, output)
+        if not os.path.exists(path) or open(path, "rb").read() != data:
+            with open(path, "wb") as f:
+                f.write(data)
+
+    for name in os.listdir(output_dir):
+        if name.endswith(".gz") and name not in outputs:
+            os.remove(os.path.join(output_dir, name))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    build(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        build(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# HTTP load test for the device: requests per second and latency percentiles
+# for one endpoint at 1, 4 and 16 concurrent clients.
+#
+#   tools/load_test.py 192.168.1.50
+#   tools/load_test.py 192.168.1.50 --path /metrics --duration 20 --clients 1 2 8
+#
+# Each client is a thread sending requests back to back over one connection,
+# reconnecting whenever the server closes it. Failed requests are counted and
+# left out of the latency figures.
+
+import argparse
+import http.client
+import threading
+import time
+
+
+def client(host, port, path, deadline, latencies, errors):
+    connection = http.client.HTTPConnection(host, port, timeout=5)
+    while time.monotonic() < deadline:
+        start = time.monotonic()
+        try:
+            connection.request("GET", path)
+            response = connection.getresponse()
+            response.read()
+            if response.status != 200:
+                raise http.client.HTTPException(f"status {response.status}")
+            if response.getheader("Connection", "").lower() == "close":
+                connection.close()
+        except (OSError, http.client.HTTPException):
+            errors.append(1)
+            connection.close()
+            continue
+        latencies.append(time.monotonic() - start)
+    connection.close()
+
+
+def percentile(values, fraction):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def run(host, port, path, clients, duration):
+    latencies, errors = [], []
+    deadline = time.monotonic() + duration
+    threads = [threading.Thread(target=client, args=(host, port, path, deadline, latencies, errors))
+               for _ in range(clients)]
+    start = time.monotonic()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+
+    print(f"{clients:7d} {len(latencies) / elapsed:9.1f} {percentile(latencies, 0.5) * 1000:8.1f} "
+          f"{percentile(latencies, 0.99) * 1000:8.1f} {max(latencies, default=float('nan')) * 1000:8.1f} "
+          f"{len(errors):7d}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HTTP load test for LightTrack")
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--path", default="/api/state")
+    parser.add_argument("--duration", type=float, default=10, help="seconds per client count")
+    parser.add_argument("--clients", type=int, nargs="+", default=[1, 4, 16])
+    args = parser.parse_args()
+
+    print(f"GET http://{args.host}:{args.port}{args.path}, {args.duration:g} s per run")
+    print(f"{'clients':>7} {'req/s':>9} {'p50 ms':>8} {'p99 ms':>8} {'max ms':>8} {'errors':>7}")
+    for clients in args.clients:
+        run(args.host, args.port, args.path, clients, args.duration)
+
+
+if __name__ == "__main__":
+    main()
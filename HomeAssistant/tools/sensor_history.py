@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""Fetch the sensor history from /api/sensor/history and print it as CSV
+(sequence, time in ms, raw distance, filtered position), for tuning
+NOISE_THRESHOLD and the beam mapping offline.
+
+  tools/sensor_history.py 192.168.1.50               everything kept, once
+  tools/sensor_history.py 192.168.1.50 --follow 2    keep polling every 2 s
+"""
+
+import argparse
+import struct
+import sys
+import time
+import urllib.request
+
+HEADER = struct.Struct("<IIHH")
+SAMPLE = struct.Struct("<HHH")
+
+
+def fetch(host, since):
+    with urllib.request.urlopen(f"http://{host}/api/sensor/history?since={since}", timeout=5) as response:
+        data = response.read()
+    first, timestamp, count, scale = HEADER.unpack_from(data)
+    samples = []
+    for i in range(count):
+        dt, raw, position = SAMPLE.unpack_from(data, HEADER.size + i * SAMPLE.size)
+        timestamp += dt
+        samples.append((first + i, timestamp, raw, position / scale))
+    return samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--since", type=int, default=0, help="last sequence already seen")
+    parser.add_argument("--follow", type=float, metavar="SECONDS", help="poll at this interval")
+    args = parser.parse_args()
+
+    since = args.since
+    print("sequence,time_ms,raw,filtered")
+    while True:
+        samples = fetch(args.host, since)
+        if samples and since and samples[0][0] != since + 1:
+            print(f"# {samples[0][0] - since - 1} samples lost", file=sys.stderr)
+        for sequence, timestamp, raw, filtered in samples:
+            print(f"{sequence},{timestamp},{raw},{filtered:.2f}")
+        if samples:
+            # A reply ends early at a gap of more than 65.5 s; the rest
+            # follows, with its own start time, in the next one
+            since = samples[-1][0]
+            continue
+        if args.follow is None:
+            break
+        sys.stdout.flush()
+        time.sleep(args.follow)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,205 @@
+// LightTrack web UI. Pages are static; live values come from /api/state.
+
+function send(url) {
+  return fetch(url);
+}
+
+function byId(id) {
+  return document.getElementById(id);
+}
+
+function hex2(value) {
+  return (value < 16 ? '0' : '') + value.toString(16);
+}
+
+function pad2(value) {
+  return (value < 10 ? '0' : '') + value;
+}
+
+// ------------------------- Main page -------------------------
+
+function setDeviceTime() {
+  var now = new Date();
+  var epoch = Math.floor(now.getTime() / 1000);
+  var tz = -now.getTimezoneOffset();
+  send('/setTime?epoch=' + epoch + '&tz=' + tz);
+}
+
+// Apply any subset of the settings in one request; the device answers with
+// its new state, or leaves everything unchanged if a value is rejected
+function setConfig(config) {
+  return fetch('/api/config', {
+    method: 'POST',
+    headers: { 'Content-Type': 'application/json' },
+    body: JSON.stringify(config)
+  }).then(function (r) { return r.json(); }).then(function (state) {
+    if (state.error) {
+      alert('Setting ' + state.field + ' not saved: ' + state.error);
+      return loadState();
+    }
+    showState(state);
+  });
+}
+
+function changeBaseColor(hex) {
+  setConfig({ baseColor: [
+    parseInt(hex.substring(1, 3), 16),
+    parseInt(hex.substring(3, 5), 16),
+    parseInt(hex.substring(5, 7), 16)
+  ] });
+}
+
+function setSchedule() {
+  var s = byId('scheduleStart').value.split(':');
+  var e = byId('scheduleEnd').value.split(':');
+  setConfig({ schedule: {
+    startHour: +s[0], startMinute: +s[1], endHour: +e[0], endMinute: +e[1]
+  } });
+}
+
+var backgroundMode = false;
+
+function toggleBackgroundMode() {
+  setConfig({ backgroundMode: !backgroundMode });
+}
+
+// A slider and the label showing its value
+function bindSlider(id, value) {
+  var slider = byId(id);
+  var label = byId(id + 'Value');
+  slider.value = value;
+  label.innerText = value;
+  slider.oninput = function () { label.innerText = this.value; };
+}
+
+function showState(state) {
+  var c = state.baseColor;
+  byId('baseColor').value = '#' + hex2(c[0]) + hex2(c[1]) + hex2(c[2]);
+
+  byId('movingLength').max = state.ledCount;
+  byId('speedMultiplier').max = state.maxSpeedMultiplier;
+  bindSlider('movingIntensity', state.movingIntensity);
+  bindSlider('movingLength', state.movingLength);
+  bindSlider('additionalLEDs', state.additionalLEDs);
+  bindSlider('centerShift', state.centerShift);
+  bindSlider('ledOffDelay', state.ledOffDelay);
+  bindSlider('speedMultiplier', state.speedMultiplier);
+  bindSlider('stationaryIntensity', Math.round(state.stationaryIntensity * 10000) / 100);
+
+  backgroundMode = state.backgroundMode;
+  byId('backgroundMode').innerText = (backgroundMode ? 'Disable' : 'Enable') + ' Background Light';
+
+  byId('scheduleStart').value = pad2(state.schedule.startHour) + ':' + pad2(state.schedule.startMinute);
+  byId('scheduleEnd').value = pad2(state.schedule.endHour) + ':' + pad2(state.schedule.endMinute);
+
+  byId('maxNumLeds').innerText = state.maxNumLeds;
+  byId('numLeds').max = state.maxNumLeds;
+  byId('numLeds').value = state.numLeds;
+  byId('ledMemory').innerText = 'LED buffers: ' + state.ledMemoryUsed + ' of ' +
+    state.ledMemoryReserved + ' bytes for ' + state.ledCount + ' LEDs';
+
+  byId('wifiStatus').innerText = state.wifi.connected ?
+    'WiFi: Connected to ' + state.wifi.ssid + ' (' + state.wifi.ip + ')' : '';
+}
+
+function loadState() {
+  return fetch('/api/state').then(function (r) { return r.json(); }).then(showState);
+}
+
+// ------------------------- MQTT page -------------------------
+
+function showMqtt(state) {
+  byId('mqttServer').value = state.mqtt.server;
+  byId('mqttPort').value = state.mqtt.port;
+  byId('mqttUser').value = state.mqtt.user;
+}
+
+// ------------------------- Sensor debug page -------------------------
+
+var dataPoints = [];
+var maxDataPoints = 200;
+var noiseThreshold = 0;
+
+function drawChart(noiseThreshold) {
+  var canvas = byId('sensorChart');
+  var ctx = canvas.getContext('2d');
+  var w = canvas.width, h = canvas.height;
+  ctx.clearRect(0, 0, w, h);
+
+  var min = Math.max(0, Math.min.apply(null, dataPoints) - 50);
+  var max = Math.max.apply(null, dataPoints) + 50;
+
+  ctx.strokeStyle = '#666';
+  ctx.beginPath();
+  ctx.moveTo(30, 10);
+  ctx.lineTo(30, h - 20);
+  ctx.lineTo(w - 10, h - 20);
+  ctx.stroke();
+
+  ctx.fillStyle = '#888';
+  ctx.font = '10px Arial';
+  var yStep = (h - 30) / 5, valueStep = (max - min) / 5;
+  for (var i = 0; i <= 5; i++) {
+    var y = h - 20 - i * yStep;
+    ctx.fillText(Math.round(min + i * valueStep), 5, y + 3);
+    ctx.strokeStyle = '#444';
+    ctx.beginPath();
+    ctx.moveTo(30, y);
+    ctx.lineTo(w - 10, y);
+    ctx.stroke();
+  }
+
+  if (noiseThreshold) {
+    var ny = h - 20 - (noiseThreshold - min) / (max - min) * (h - 30);
+    ctx.strokeStyle = '#ffaa00';
+    ctx.beginPath();
+    ctx.moveTo(30, ny);
+    ctx.lineTo(w - 10, ny);
+    ctx.stroke();
+    ctx.fillText('Noise', w - 50, ny - 5);
+  }
+
+  if (dataPoints.length > 1) {
+    var xStep = (w - 40) / (maxDataPoints - 1);
+    ctx.strokeStyle = '#00aaff';
+    ctx.lineWidth = 2;
+    ctx.beginPath();
+    for (var j = 0; j < dataPoints.length; j++) {
+      var x = 30 + j * xStep;
+      var py = h - 20 - (dataPoints[j] - min) / (max - min) * (h - 30);
+      if (j === 0) ctx.moveTo(x, py); else ctx.lineTo(x, py);
+    }
+    ctx.stroke();
+  }
+}
+
+// Samples are pushed by the device in batches: "t0,d0;dt1,d1;..."
+function streamSensor() {
+  var stream = new EventSource('/api/sensor/stream');
+  stream.addEventListener('config', function (e) {
+    noiseThreshold = JSON.parse(e.data).noise_threshold;
+  });
+  stream.onmessage = function (e) {
+    var samples = e.data.split(';');
+    for (var i = 0; i < samples.length; i++) {
+      dataPoints.push(parseInt(samples[i].split(',')[1], 10));
+    }
+    if (dataPoints.length > maxDataPoints) dataPoints.splice(0, dataPoints.length - maxDataPoints);
+    byId('currentValue').textContent = dataPoints[dataPoints.length - 1];
+    drawChart(noiseThreshold);
+  };
+}
+
+// -------------------------------------------------------------------
+
+document.addEventListener('DOMContentLoaded', function () {
+  var page = document.body.dataset.page;
+  if (page === 'main') {
+    setDeviceTime();
+    loadState();
+  } else if (page === 'mqtt') {
+    fetch('/api/state').then(function (r) { return r.json(); }).then(showMqtt);
+  } else if (page === 'debug') {
+    streamSensor();
+  }
+});